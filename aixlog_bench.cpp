@@ -0,0 +1,409 @@
+/***
+      __   __  _  _  __     __    ___
+     / _\ (  )( \/ )(  )   /  \  / __)
+    /    \ )(  )  ( / (_/\(  O )( (_ \
+    \_/\_/(__)(_/\_)\____/ \__/  \___/
+
+    This file is part of aixlog
+    Copyright (C) 2017-2021 Johannes Pohl
+
+    This software may be modified and distributed under the terms
+    of the MIT license.  See the LICENSE file for details.
+***/
+
+
+#include "aixlog.hpp"
+
+#include <cstdlib>
+#include <ctime>
+#include <new>
+
+using namespace std;
+using namespace std::chrono;
+
+
+// GCC can't tell that the replaced operator delete matches the replaced operator new
+#if defined(__GNUC__) && !defined(__clang__) && (__GNUC__ >= 11)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+/// Heap allocations of the whole process, counted by the replaced global operator new
+static atomic<size_t> allocations(0);
+
+void* operator new(size_t size)
+{
+    allocations.fetch_add(1, memory_order_relaxed);
+    void* p = malloc((size == 0) ? 1 : size);
+    if (p == nullptr)
+        throw bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t /*size*/) noexcept
+{
+    free(p);
+}
+
+
+/// Renders every line, like a formatting sink that writes to a device, but drops the result
+struct SinkFormatNull : public AixLog::SinkFormat
+{
+    SinkFormatNull(const AixLog::Filter& filter, const string& format) : AixLog::SinkFormat(filter, format)
+    {
+    }
+
+    void log(const AixLog::Metadata& metadata, const string& message) override
+    {
+        render(metadata, message);
+    }
+};
+
+
+/// Renders every line like SinkFormat did before patterns were parsed once and rendered lines were shared:
+/// strftime over the whole format and a search and replace per placeholder, for every sink on its own
+struct SinkFormatBaseline : public AixLog::Sink
+{
+    SinkFormatBaseline(const AixLog::Filter& filter, const string& format) : AixLog::Sink(filter), format_(format)
+    {
+    }
+
+    void log(const AixLog::Metadata& metadata, const string& message) override
+    {
+        string result = format_;
+        if (metadata.timestamp)
+            result = timestamp(metadata.timestamp, result);
+
+        replace(result, "#severity", AixLog::to_string(metadata.severity));
+        if (result.find("#color_severity") != string::npos)
+        {
+            stringstream ss;
+            ss << AixLog::TextColor(AixLog::Color::RED) << AixLog::to_string(metadata.severity) << AixLog::TextColor(AixLog::Color::NONE);
+            replace(result, "#color_severity", ss.str());
+        }
+        replace(result, "#tag_func", metadata.tag ? metadata.tag.text : (metadata.function ? metadata.function.name : "log"));
+        replace(result, "#tag", metadata.tag ? metadata.tag.text : "");
+        replace(result, "#function", metadata.function ? metadata.function.name : "");
+        if (result.find("#message") != string::npos)
+            replace(result, "#message", message);
+        else if (result.empty() || (result.back() == ' '))
+            result += message;
+        else
+            result += " " + message;
+        line_ = result;
+    }
+
+private:
+    static void replace(string& text, const string& placeholder, const string& value)
+    {
+        size_t pos = text.find(placeholder);
+        if (pos != string::npos)
+            text.replace(pos, placeholder.size(), value);
+    }
+
+    static string timestamp(const AixLog::Timestamp& timestamp, const string& format)
+    {
+        time_t now_c = system_clock::to_time_t(timestamp.time_point);
+        struct tm now_tm;
+#ifdef _WIN32
+        localtime_s(&now_tm, &now_c);
+#else
+        localtime_r(&now_c, &now_tm);
+#endif
+        char buffer[256];
+        strftime(buffer, sizeof buffer, format.c_str(), &now_tm);
+        string result(buffer);
+        size_t pos = result.find("#ms");
+        if (pos != string::npos)
+        {
+            int ms_part = time_point_cast<milliseconds>(timestamp.time_point).time_since_epoch().count() % 1000;
+            char ms_str[4];
+            if (snprintf(ms_str, 4, "%03d", ms_part) >= 0)
+                result.replace(pos, 3, ms_str);
+        }
+        return result;
+    }
+
+    string format_;
+    string line_;
+};
+
+
+/// Sinks under test, and how to log a line to them
+struct Scenario
+{
+    /// @param sinks number of sinks that "make_sink" creates, e.g. several with the same format
+    Scenario(const string& name, const function<AixLog::log_sink_ptr()>& make_sink, const function<void(int)>& log_line, size_t sinks = 1)
+        : name(name), make_sink(make_sink), log_line(log_line), sinks(sinks)
+    {
+    }
+
+    vector<AixLog::log_sink_ptr> make_sinks() const
+    {
+        vector<AixLog::log_sink_ptr> result;
+        for (size_t n = 0; n < sinks; ++n)
+            result.push_back(make_sink());
+        return result;
+    }
+
+    string name;
+    function<AixLog::log_sink_ptr()> make_sink;
+    function<void(int)> log_line;
+    size_t sinks;
+};
+
+
+static void log_text(int n)
+{
+    LOG(INFO) << "value " << n << " of " << 1000 << " name " << "aixlog" << "\n";
+}
+
+static void log_text_filtered(int n)
+{
+    LOG(DEBUG) << "value " << n << " of " << 1000 << " name " << "aixlog" << "\n";
+}
+
+static void log_format(int n)
+{
+    LOGF(INFO, "value {} of {} name {}", n, 1000, "aixlog");
+}
+
+static void log_fields(int n)
+{
+    LOGF(INFO, "value {} of {}", n, 1000, FIELD("name", "aixlog"), FIELD("n", n));
+}
+
+static void log_binary(int n)
+{
+    LOGB(INFO, "value {} of {} name {}", n, 1000, "aixlog");
+}
+
+/// Lines of a failed Scope reach the sinks with one "log_batch" call. Every 16th call logs 16 lines, so the cost per call is the one per line.
+static void log_batch(int n)
+{
+    if (n % 16 != 0)
+        return;
+    AixLog::Scope scope;
+    for (int line = n; line < n + 16; ++line)
+        LOG(INFO) << "value " << line << " of " << 1000 << " name " << "aixlog" << "\n";
+    scope.fail();
+}
+
+
+struct Result
+{
+    double ns_per_line;
+    double p50;
+    double p99;
+    double p999;
+    double filtered_ns_per_line;
+    double allocations_per_line;
+    vector<pair<size_t, double>> lines_per_second;
+};
+
+
+static double elapsed_ns(const steady_clock::time_point& start)
+{
+    return duration<double, nano>(steady_clock::now() - start).count();
+}
+
+static double percentile(const vector<double>& sorted, double p)
+{
+    return sorted[min(sorted.size() - 1, static_cast<size_t>(p * static_cast<double>(sorted.size())))];
+}
+
+/// @return lines per second of "threads" threads that log "lines_per_thread" lines each
+static double lines_per_second(const Scenario& scenario, int lines_per_thread, size_t threads)
+{
+    vector<thread> workers;
+    auto start = steady_clock::now();
+    for (size_t t = 0; t < threads; ++t)
+    {
+        workers.emplace_back([&scenario, lines_per_thread] {
+            for (int n = 0; n < lines_per_thread; ++n)
+                scenario.log_line(n);
+        });
+    }
+    for (auto& worker : workers)
+        worker.join();
+    return static_cast<double>(lines_per_thread) * static_cast<double>(threads) * 1e9 / elapsed_ns(start);
+}
+
+static Result run(const Scenario& scenario, int lines, size_t max_threads)
+{
+    Result result;
+    AixLog::Log::init(scenario.make_sinks());
+
+    // warm up: call sites, thread's record, sink buffers
+    for (int n = 0; n < 1000; ++n)
+        scenario.log_line(n);
+
+    auto start = steady_clock::now();
+    for (int n = 0; n < lines; ++n)
+        scenario.log_line(n);
+    result.ns_per_line = elapsed_ns(start) / lines;
+
+    vector<double> latencies(static_cast<size_t>(lines));
+    for (int n = 0; n < lines; ++n)
+    {
+        auto line_start = steady_clock::now();
+        scenario.log_line(n);
+        latencies[static_cast<size_t>(n)] = elapsed_ns(line_start);
+    }
+    sort(latencies.begin(), latencies.end());
+    result.p50 = percentile(latencies, 0.5);
+    result.p99 = percentile(latencies, 0.99);
+    result.p999 = percentile(latencies, 0.999);
+
+    start = steady_clock::now();
+    for (int n = 0; n < lines; ++n)
+        log_text_filtered(n);
+    result.filtered_ns_per_line = elapsed_ns(start) / lines;
+
+    size_t allocations_before = allocations.load();
+    for (int n = 0; n < lines; ++n)
+        scenario.log_line(n);
+    result.allocations_per_line = static_cast<double>(allocations.load() - allocations_before) / lines;
+
+    for (size_t threads = 1; threads <= max_threads; threads *= 2)
+        result.lines_per_second.emplace_back(threads, lines_per_second(scenario, max(1, lines / static_cast<int>(threads)), threads));
+
+    AixLog::Log::init({});
+    return result;
+}
+
+/// Contention: 1 to "max_threads" threads log "lines" lines each into the same sinks
+static string run_scaling(const Scenario& scenario, int lines, size_t max_threads)
+{
+    AixLog::Log::init(scenario.make_sinks());
+    for (int n = 0; n < 1000; ++n)
+        scenario.log_line(n);
+
+    stringstream total;
+    stringstream per_thread;
+    for (size_t threads = 1; threads <= max_threads; ++threads)
+    {
+        double result = lines_per_second(scenario, lines, threads);
+        total << ((threads == 1) ? "" : ", ") << "\"" << threads << "\": " << static_cast<uint64_t>(result);
+        per_thread << ((threads == 1) ? "" : ", ") << "\"" << threads << "\": " << static_cast<uint64_t>(result / static_cast<double>(threads));
+    }
+    AixLog::Log::init({});
+
+    stringstream json;
+    json << "{\n  \"lines_per_thread\": " << lines << ",\n  \"scaling\": {\n"
+         << "    \"name\": \"" << scenario.name << "\",\n"
+         << "    \"lines_per_second\": {" << total.str() << "},\n"
+         << "    \"lines_per_second_per_thread\": {" << per_thread.str() << "}\n  }\n}\n";
+    return json.str();
+}
+
+
+static int usage()
+{
+    cerr << "usage: aixlog_bench [-n <lines>] [-t <max threads>] [-s <scenario>] [-o <json file>]\n"
+         << "Measures the logging cost per sink, writes the results as JSON to stdout or to the file\n"
+         << "With -s, 1 to <max threads> threads log <lines> lines each into the scenario's sinks, to measure the contention\n";
+    return 1;
+}
+
+
+int main(int argc, char** argv)
+{
+    int lines = 200000;
+    size_t max_threads = max(4u, thread::hardware_concurrency());
+    string output;
+    string scaling;
+    for (int n = 1; n < argc; ++n)
+    {
+        string arg(argv[n]);
+        if ((arg == "-n") && (n + 1 < argc))
+            lines = max(1, atoi(argv[++n]));
+        else if ((arg == "-t") && (n + 1 < argc))
+            max_threads = static_cast<size_t>(max(1, atoi(argv[++n])));
+        else if ((arg == "-o") && (n + 1 < argc))
+            output = argv[++n];
+        else if ((arg == "-s") && (n + 1 < argc))
+            scaling = argv[++n];
+        else
+            return usage();
+    }
+
+    const string file = "aixlog_bench.log";
+    const string format = "%Y-%m-%d %H-%M-%S.#ms [#severity] (#tag_func)";
+    AixLog::Filter filter(AixLog::Severity::info);
+    vector<Scenario> scenarios = {
+        {"null",
+         [&] {
+             auto sink = make_shared<AixLog::SinkNull>();
+             sink->filter = filter;
+             return sink;
+         },
+         log_text},
+        {"null_logf",
+         [&] {
+             auto sink = make_shared<AixLog::SinkNull>();
+             sink->filter = filter;
+             return sink;
+         },
+         log_format},
+        {"callback", [&] { return make_shared<AixLog::SinkCallback>(filter, [](const AixLog::Metadata&, const string&) {}); }, log_text},
+        {"format", [&] { return make_shared<SinkFormatNull>(filter, format); }, log_text},
+        {"format_baseline", [&] { return make_shared<SinkFormatBaseline>(filter, format); }, log_text},
+        {"format_x4", [&] { return make_shared<SinkFormatNull>(filter, format); }, log_text, 4},
+        {"format_baseline_x4", [&] { return make_shared<SinkFormatBaseline>(filter, format); }, log_text, 4},
+        {"file", [&] { return make_shared<AixLog::SinkFile>(filter, file, format); }, log_text},
+        {"file_buffered", [&] { return make_shared<AixLog::SinkFile>(filter, file, format, AixLog::SinkFile::FlushPolicy::buffered()); }, log_text},
+        {"file_buffered_logf", [&] { return make_shared<AixLog::SinkFile>(filter, file, format, AixLog::SinkFile::FlushPolicy::buffered()); }, log_format},
+        {"file_buffered_batch", [&] { return make_shared<AixLog::SinkFile>(filter, file, format, AixLog::SinkFile::FlushPolicy::buffered()); }, log_batch},
+        {"binary", [&] { return make_shared<AixLog::SinkBinary>(filter, file); }, log_binary},
+        {"json_buffered", [&] { return make_shared<AixLog::SinkJson>(filter, file, "%Y-%m-%dT%H:%M:%S.#us%z", AixLog::SinkFile::FlushPolicy::buffered()); },
+         log_fields},
+    };
+
+    stringstream json;
+    if (!scaling.empty())
+    {
+        auto scenario = find_if(scenarios.begin(), scenarios.end(), [&scaling](const Scenario& s) { return s.name == scaling; });
+        if (scenario == scenarios.end())
+            return usage();
+        json << run_scaling(*scenario, lines, max_threads);
+    }
+    else
+    {
+        json << "{\n  \"lines\": " << lines << ",\n  \"scenarios\": [";
+        for (size_t s = 0; s < scenarios.size(); ++s)
+        {
+            Result result = run(scenarios[s], lines, max_threads);
+            json << ((s == 0) ? "\n" : ",\n") << "    {\n"
+                 << "      \"name\": \"" << scenarios[s].name << "\",\n"
+                 << "      \"ns_per_line\": " << result.ns_per_line << ",\n"
+                 << "      \"latency_ns\": {\"p50\": " << result.p50 << ", \"p99\": " << result.p99 << ", \"p99.9\": " << result.p999 << "},\n"
+                 << "      \"filtered_ns_per_line\": " << result.filtered_ns_per_line << ",\n"
+                 << "      \"allocations_per_line\": " << result.allocations_per_line << ",\n"
+                 << "      \"lines_per_second\": {";
+            for (size_t t = 0; t < result.lines_per_second.size(); ++t)
+            {
+                const auto& threads = result.lines_per_second[t];
+                json << ((t == 0) ? "" : ", ") << "\"" << threads.first << "\": " << static_cast<uint64_t>(threads.second);
+            }
+            json << "}\n    }";
+        }
+        json << "\n  ]\n}\n";
+    }
+    remove(file.c_str());
+
+    if (output.empty())
+    {
+        cout << json.str();
+    }
+    else
+    {
+        ofstream ofs(output.c_str());
+        ofs << json.str();
+    }
+    return 0;
+}
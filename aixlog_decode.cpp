@@ -0,0 +1,71 @@
+/***
+      __   __  _  _  __     __    ___
+     / _\ (  )( \/ )(  )   /  \  / __)
+    /    \ )(  )  ( / (_/\(  O )( (_ \
+    \_/\_/(__)(_/\_)\____/ \__/  \___/
+
+    This file is part of aixlog
+    Copyright (C) 2017-2021 Johannes Pohl
+
+    This software may be modified and distributed under the terms
+    of the MIT license.  See the LICENSE file for details.
+***/
+
+
+#include "aixlog.hpp"
+
+using namespace std;
+
+
+static int usage()
+{
+    cerr << "usage: aixlog_decode [-f <format>] <file>...\n"
+         << "Renders logs written by AixLog::SinkBinary as text, by default with the format that is stored in the file\n";
+    return 1;
+}
+
+
+int main(int argc, char** argv)
+{
+    string format;
+    vector<string> files;
+    for (int n = 1; n < argc; ++n)
+    {
+        string arg(argv[n]);
+        if ((arg == "-f") && (n + 1 < argc))
+            format = argv[++n];
+        else if (!arg.empty() && (arg[0] == '-'))
+            return usage();
+        else
+            files.push_back(arg);
+    }
+
+    if (files.empty())
+        return usage();
+
+    int result = 0;
+    for (const auto& file : files)
+    {
+        ifstream in(file.c_str(), ios::binary);
+        if (!in)
+        {
+            cerr << "aixlog_decode: failed to open \"" << file << "\"\n";
+            result = 1;
+            continue;
+        }
+
+        string file_format;
+        unique_ptr<AixLog::SinkCout> sink;
+        bool ok = AixLog::SinkBinary::decode(in, file_format, [&](const AixLog::Metadata& metadata, const string& message) {
+            if (!sink)
+                sink.reset(new AixLog::SinkCout(AixLog::Severity::trace, format.empty() ? file_format : format));
+            sink->log(metadata, message);
+        });
+        if (!ok)
+        {
+            cerr << "aixlog_decode: \"" << file << "\" is not a binary log of version " << static_cast<int>(AixLog::SinkBinary::version) << ", or it is truncated\n";
+            result = 1;
+        }
+    }
+    return result;
+}
@@ -18,6 +18,7 @@ using namespace std;
 
 
 /// Log Conditional to log only every x-th message
+/// Not thread safe, EVERY_N is a thread safe alternative
 struct EveryXConditional : public AixLog::Conditional
 {
     /// c'tor
@@ -144,4 +145,8 @@ int main(int /*argc*/, char** /*argv*/)
     LOG(INFO) << not_every_3 << "4th will be logged\n";
     LOG(INFO) << not_every_3 << "5th will be logged\n";
     LOG(INFO) << not_every_3 << "6th will not be logged\n";
+
+    /// Thread safe limiters, every LOG statement has its own. Suppressed lines are summarized.
+    for (int n = 1; n <= 6; ++n)
+        LOG(INFO) << EVERY_N(3) << "EVERY_N(3): " << n << " will " << ((n % 3 == 1) ? "" : "not ") << "be logged\n";
 }
@@ -0,0 +1,232 @@
+/***
+      __   __  _  _  __     __    ___
+     / _\ (  )( \/ )(  )   /  \  / __)
+    /    \ )(  )  ( / (_/\(  O )( (_ \
+    \_/\_/(__)(_/\_)\____/ \__/  \___/
+
+    This file is part of aixlog
+    Copyright (C) 2017-2021 Johannes Pohl
+
+    This software may be modified and distributed under the terms
+    of the MIT license.  See the LICENSE file for details.
+***/
+
+
+#include "aixlog.hpp"
+
+using namespace std;
+
+
+static int failures = 0;
+
+static void check(bool condition, const string& what)
+{
+    if (!condition)
+    {
+        cerr << "FAILED: " << what << "\n";
+        ++failures;
+    }
+}
+
+
+/// Counts the lines that reach it
+struct SinkCount : public AixLog::Sink
+{
+    SinkCount(const AixLog::Filter& filter) : AixLog::Sink(filter), lines(0)
+    {
+    }
+
+    void log(const AixLog::Metadata& /*metadata*/, const string& /*message*/) override
+    {
+        ++lines;
+    }
+
+    size_t lines;
+};
+
+
+static void log_info()
+{
+    LOG(INFO) << "info\n";
+}
+
+static void log_warning()
+{
+    LOG(WARNING) << "warning\n";
+}
+
+
+/// Assigning a sink's filter as a whole after Log::init takes effect right away, in both directions
+static void test_assign_filter()
+{
+    auto sink = make_shared<SinkCount>(AixLog::Severity::warning);
+    AixLog::Log::init({sink});
+    log_info();
+    log_warning();
+    check(sink->lines == 1, "filter warning: only the warning line passes");
+
+    sink->filter = AixLog::Filter(AixLog::Severity::info);
+    log_info();
+    log_warning();
+    check(sink->lines == 3, "filter assigned to info: the info line passes");
+
+    sink->filter = AixLog::Filter(AixLog::Severity::error);
+    log_info();
+    log_warning();
+    check(sink->lines == 3, "filter assigned to error: no line passes");
+
+    AixLog::Filter tags;
+    tags.add_filter("*:error,net:info");
+    sink->filter = tags;
+    log_warning();
+    LOG(INFO, "net") << "net\n";
+    check(sink->lines == 4, "filter assigned with tags: only the net line passes");
+    AixLog::Log::init();
+}
+
+
+static size_t tags_made = 0;
+
+static string make_tag()
+{
+    ++tags_made;
+    return "made";
+}
+
+/// A tag that is not a string literal is evaluated once, and not at all if the statement is disabled
+static void test_tag_evaluated_once()
+{
+    auto sink = make_shared<SinkCount>(AixLog::Severity::info);
+    AixLog::Log::init({sink});
+    LOG(INFO, make_tag()) << "enabled\n";
+    check(tags_made == 1, "LOG: tag evaluated once");
+    LOG(DEBUG, make_tag()) << "disabled\n";
+    check(tags_made == 1, "LOG: tag of a disabled statement not evaluated");
+    LOGF_TAG(INFO, make_tag(), "enabled {}", 1);
+    check(tags_made == 2, "LOGF_TAG: tag evaluated once");
+    LOGF_TAG(DEBUG, make_tag(), "disabled {}", 1);
+    check(tags_made == 2, "LOGF_TAG: tag of a disabled statement not evaluated");
+    check(sink->lines == 2, "the enabled lines pass");
+    AixLog::Log::init();
+}
+
+
+/// Sinks can be copied, the copy has its own lock and counters and gets its own lines
+static void test_copy_sink()
+{
+    size_t lines = 0;
+    AixLog::SinkCallback original(AixLog::Severity::info, [&lines](const AixLog::Metadata& /*metadata*/, const string& /*message*/) { ++lines; });
+    auto sink = make_shared<AixLog::SinkCallback>(original);
+    AixLog::Log::init({sink});
+    log_info();
+    check(lines == 1, "copied SinkCallback gets the line");
+    check(sink->metrics().written == 1, "copied SinkCallback counts the line");
+    check(original.metrics().written == 0, "original SinkCallback doesn't count the copy's line");
+    original = *sink;
+    check(original.metrics().written == 0, "assigned SinkCallback keeps its counters");
+
+    AixLog::SinkCout cout_sink(AixLog::Severity::info, "#message");
+    AixLog::SinkCout cout_copy(cout_sink);
+    cout_copy.set_format("copy: #message");
+    cout_sink = cout_copy;
+    AixLog::Log::init();
+}
+
+
+/// A SinkFile subclass that overrides "log", as sinks did before "log_record" existed
+struct SinkPrefixFile : public AixLog::SinkFile
+{
+    SinkPrefixFile(const string& filename) : AixLog::SinkFile(AixLog::Severity::trace, filename, "#message")
+    {
+    }
+
+    void log(const AixLog::Metadata& metadata, const string& message) override
+    {
+        AixLog::SinkFile::log(metadata, "PREFIX " + message);
+    }
+};
+
+/// A SinkNull subclass that overrides "log"
+struct SinkNullCount : public AixLog::SinkNull
+{
+    SinkNullCount() : lines(0)
+    {
+    }
+
+    void log(const AixLog::Metadata& /*metadata*/, const string& /*message*/) override
+    {
+        ++lines;
+    }
+
+    size_t lines;
+};
+
+/// Subclasses of the sinks that take lines as RecordView still get them through their "log"
+static void test_overridden_log()
+{
+    const string filename = "aixlog_test_prefix.log";
+    auto file = make_shared<SinkPrefixFile>(filename);
+    auto null = make_shared<SinkNullCount>();
+    AixLog::Log::init({file, null});
+    LOG(INFO) << "single\n";
+    {
+        AixLog::Scope scope;
+        LOG(INFO) << "batch 1\n";
+        LOG(INFO) << "batch 2\n";
+        scope.fail();
+    }
+    AixLog::Log::init();
+    check(null->lines == 3, "SinkNull subclass: log is called for every line");
+    file.reset();
+
+    ifstream ifs(filename.c_str());
+    string content((istreambuf_iterator<char>(ifs)), istreambuf_iterator<char>());
+    check(content == "PREFIX single\nPREFIX batch 1\nPREFIX batch 2\n", "SinkFile subclass: log is called for every line, got \"" + content + "\"");
+    remove(filename.c_str());
+}
+
+
+/// Lines suppressed at the end of a burst are summarized by Log::flush and by Log::init, with the severity and tag of the last one
+static void test_limiter_summary()
+{
+    vector<string> lines;
+    auto sink = make_shared<AixLog::SinkCallback>(AixLog::Severity::info, [&lines](const AixLog::Metadata& metadata, const string& message) {
+        lines.push_back(to_string(metadata.severity) + " " + metadata.tag.text + " " + message);
+    });
+    AixLog::Log::init({sink});
+    for (int n = 0; n < 5; ++n)
+        LOG(WARNING, "burst") << EVERY_N(10) << "burst\n";
+    check(lines.size() == 1, "EVERY_N: the first line of the burst passes");
+    AixLog::Log::instance().flush();
+    check((lines.size() == 2) && (lines.back() == "Warn burst suppressed 4 messages"), "EVERY_N: flush summarizes the rest of the burst");
+    AixLog::Log::instance().flush();
+    check(lines.size() == 2, "EVERY_N: nothing left to summarize");
+
+    AixLog::Filter filter(AixLog::Severity::info);
+    filter.add_limit("net", AixLog::EveryN(3));
+    sink->filter = filter;
+    for (int n = 0; n < 3; ++n)
+        LOG(INFO, "net") << "net\n";
+    check(lines.size() == 3, "filter limiter: the first line passes");
+    AixLog::Log::init();
+    check((lines.size() == 4) && (lines.back() == "Info net suppressed 2 messages"), "filter limiter: init summarizes the rest for the replaced sink");
+
+    const double nan = numeric_limits<double>::quiet_NaN();
+    check(!AixLog::RateLimit(nan).allow(), "RateLimit(NaN) lets nothing pass");
+    AixLog::RateLimit slow(1e-30);
+    check(slow.allow() && !slow.allow(), "RateLimit(1e-30) lets one line pass");
+    check(!AixLog::Sample(nan).allow() && !AixLog::Sample(-1).allow() && AixLog::Sample(2).allow(), "Sample clamps its probability");
+}
+
+
+int main()
+{
+    test_assign_filter();
+    test_tag_evaluated_once();
+    test_copy_sink();
+    test_overridden_log();
+    test_limiter_summary();
+    if (failures == 0)
+        cout << "all tests passed\n";
+    return (failures == 0) ? 0 : 1;
+}
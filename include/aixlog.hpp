@@ -32,19 +32,38 @@
 #endif
 
 #include <algorithm>
+#include <atomic>
 #include <cctype>
+#include <cerrno>
 #include <chrono>
+#include <cmath>
+#include <condition_variable>
 #include <cstdio>
+#include <cstring>
 #include <ctime>
 #include <fstream>
 #include <functional>
 #include <iostream>
+#include <iterator>
+#include <limits>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <sstream>
 #include <thread>
+#include <type_traits>
+#include <typeinfo>
 #include <vector>
+#if (__cplusplus >= 201703L) && defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define AIXLOG_INTERNAL__SSE2
+#include <emmintrin.h>
+#endif
 
 #ifdef __ANDROID__
 #include <android/log.h>
@@ -69,6 +88,21 @@
 #include <syslog.h>
 #endif
 
+#ifndef _WIN32
+#include <csignal>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#endif
+
+#ifdef AIXLOG_USE_ZLIB
+#include <zlib.h>
+#endif
+
 #ifdef __ANDROID__
 // fix for bug "Android NDK __func__ definition is inconsistent with glibc and C++99"
 // https://bugs.chromium.org/p/chromium/issues/detail?id=631489
@@ -81,9 +115,34 @@
 #define AIXLOG_INTERNAL__FUNC __func__
 #endif
 
+/// Compile time severity floor: LOG statements with a lower severity are compiled out, i.e. neither the
+/// time stamp, nor the function, nor any of the streamed arguments are evaluated.
+/// Define it before including aixlog.hpp as a SEVERITY name or number, e.g. -DAIXLOG_MIN_SEVERITY=INFO
+#ifndef AIXLOG_MIN_SEVERITY
+#define AIXLOG_MIN_SEVERITY 0 // TRACE
+#endif
+
 /// Internal helper macros (exposed, but shouldn't be used directly)
-#define AIXLOG_INTERNAL__LOG_SEVERITY(SEVERITY_) std::clog << static_cast<AixLog::Severity>(SEVERITY_) << TAG()
-#define AIXLOG_INTERNAL__LOG_SEVERITY_TAG(SEVERITY_, TAG_) std::clog << static_cast<AixLog::Severity>(SEVERITY_) << TAG(TAG_)
+// "cond ? (void)0 : Voidify() & stream << ..." swallows the whole << chain into the else branch and is
+// a single expression, so there is no dangling else in "if (x) LOG(INFO) << "y"; else ..."
+// At runtime the statement is skipped before anything is evaluated if its call site is disabled,
+// i.e. if no sink's filter would accept the severity (and the tag, if it's a string literal).
+#define AIXLOG_INTERNAL__LOG_IF(SEVERITY_, TAG_)                                                                                                               \
+    ((static_cast<int>(static_cast<AixLog::Severity>(SEVERITY_)) < static_cast<int>(AIXLOG_MIN_SEVERITY)) ||                                                  \
+     !AIXLOG_INTERNAL__CALL_SITE(SEVERITY_, TAG_).enabled(static_cast<AixLog::Severity>(SEVERITY_)))                                                           \
+        ? (void)0                                                                                                                                              \
+        : AixLog::Voidify() &
+// Static descriptor of the LOG statement, registered on first execution. The lambda gives every statement its own static.
+// Only a string literal tag is evaluated here, other tags are evaluated once, by the statement itself, if it's enabled.
+#define AIXLOG_INTERNAL__CALL_SITE(SEVERITY_, TAG_)                                                                                                            \
+    [](const char* function, AixLog::Severity severity, const char* tag) -> AixLog::CallSite& {                                                               \
+        static AixLog::CallSite site(__FILE__, __LINE__, function, severity, tag);                                                                            \
+        return site;                                                                                                                                           \
+    }(AIXLOG_INTERNAL__FUNC, static_cast<AixLog::Severity>(SEVERITY_),                                                                                         \
+      AixLog::CallSite::is_static_tag<decltype(TAG_)>::value ? AixLog::CallSite::static_tag(TAG_) : nullptr)
+#define AIXLOG_INTERNAL__LOG_SEVERITY(SEVERITY_) AIXLOG_INTERNAL__LOG_IF(SEVERITY_, nullptr) std::clog << static_cast<AixLog::Severity>(SEVERITY_) << TAG()
+#define AIXLOG_INTERNAL__LOG_SEVERITY_TAG(SEVERITY_, TAG_)                                                                                                     \
+    AIXLOG_INTERNAL__LOG_IF(SEVERITY_, TAG_) std::clog << static_cast<AixLog::Severity>(SEVERITY_) << TAG(TAG_)
 
 #define AIXLOG_INTERNAL__ONE_COLOR(FG_) AixLog::Color::FG_
 #define AIXLOG_INTERNAL__TWO_COLOR(FG_, BG_) AixLog::TextColor(AixLog::Color::FG_, AixLog::Color::BG_)
@@ -97,16 +156,71 @@
 // usage: LOG(SEVERITY) or LOG(SEVERITY, TAG)
 // e.g.: LOG(NOTICE) or LOG(NOTICE, "my tag")
 #ifndef WIN32
-#define LOG(...) AIXLOG_INTERNAL__LOG_MACRO_CHOOSER(__VA_ARGS__)(__VA_ARGS__) << TIMESTAMP << FUNC
+#define LOG(...) AIXLOG_INTERNAL__LOG_MACRO_CHOOSER(__VA_ARGS__)(__VA_ARGS__) << TIMESTAMP << AIXLOG_INTERNAL__LOCATION
 #endif
 
 // usage: COLOR(TEXT_COLOR, BACKGROUND_COLOR) or COLOR(TEXT_COLOR)
 // e.g.: COLOR(yellow, blue) or COLOR(red)
 #define COLOR(...) AIXLOG_INTERNAL__COLOR_MACRO_CHOOSER(__VA_ARGS__)(__VA_ARGS__)
 
+// Formatted logging without iostreams: every "{}" in FORMAT is replaced by the next argument, "{{" and "}}" are braces.
+// The number of "{}" is checked against the number of arguments at compile time.
+// usage: LOGF(SEVERITY, FORMAT, ARGS...) or LOGF_TAG(SEVERITY, TAG, FORMAT, ARGS...), FORMAT must be a string literal
+// e.g.: LOGF(INFO, "x={} y={}", x, y) or LOGF_TAG(INFO, "net", "received {} bytes", size)
+#define LOGF(SEVERITY_, ...) AIXLOG_INTERNAL__LOGF(SEVERITY_, nullptr, __VA_ARGS__)
+#define LOGF_TAG(SEVERITY_, TAG_, ...) AIXLOG_INTERNAL__LOGF(SEVERITY_, TAG_, __VA_ARGS__)
+#define AIXLOG_INTERNAL__LOGF(SEVERITY_, TAG_, ...)                                                                                                            \
+    do                                                                                                                                                         \
+    {                                                                                                                                                          \
+        AIXLOG_INTERNAL__CHECK_FORMAT(__VA_ARGS__);                                                                                                            \
+        if (static_cast<int>(static_cast<AixLog::Severity>(SEVERITY_)) >= static_cast<int>(AIXLOG_MIN_SEVERITY))                                               \
+        {                                                                                                                                                      \
+            AixLog::CallSite& aixlog_call_site_ = AIXLOG_INTERNAL__CALL_SITE(SEVERITY_, TAG_);                                                                 \
+            if (aixlog_call_site_.enabled(static_cast<AixLog::Severity>(SEVERITY_)))                                                                           \
+                AixLog::Log::log_format(aixlog_call_site_, static_cast<AixLog::Severity>(SEVERITY_), TAG_, __VA_ARGS__);                                       \
+        }                                                                                                                                                      \
+    } while (false)
+// The extra expansion is for MSVC's preprocessor, that passes __VA_ARGS__ on as a single argument
+#define AIXLOG_INTERNAL__EXPAND(X_) X_
+#define AIXLOG_INTERNAL__FIRST(FIRST_, ...) FIRST_
+#define AIXLOG_INTERNAL__CHECK_FORMAT(...)                                                                                                                     \
+    static_assert(AixLog::Format::placeholders(AIXLOG_INTERNAL__EXPAND(AIXLOG_INTERNAL__FIRST(__VA_ARGS__, ))) ==                                              \
+                      decltype(AixLog::Format::count(__VA_ARGS__))::value - 1,                                                                                 \
+                  "the number of \"{}\" in the format doesn't match the number of arguments, or a brace is not escaped as \"{{\" or \"}}\"")
+
+// Binary logging, see SinkBinary: the arguments are passed to the sinks unformatted.
+// usage: LOGB(SEVERITY, FORMAT, ARGS...) or LOGB_TAG(SEVERITY, TAG, FORMAT, ARGS...), the format is the one of LOGF
+// e.g.: LOGB(INFO, "received {} bytes from {}", size, address) or LOGB_TAG(INFO, "net", "received {} bytes", size)
+// FORMAT and TAG must be string literals
+#define LOGB(SEVERITY_, ...) AIXLOG_INTERNAL__LOGB(SEVERITY_, nullptr, __VA_ARGS__)
+#define LOGB_TAG(SEVERITY_, TAG_, ...) AIXLOG_INTERNAL__LOGB(SEVERITY_, TAG_, __VA_ARGS__)
+#define AIXLOG_INTERNAL__LOGB(SEVERITY_, TAG_, ...)                                                                                                            \
+    do                                                                                                                                                         \
+    {                                                                                                                                                          \
+        AIXLOG_INTERNAL__CHECK_FORMAT(__VA_ARGS__);                                                                                                            \
+        static_assert(AixLog::CallSite::is_static_tag<decltype(TAG_)>::value || std::is_same<decltype(TAG_), std::nullptr_t>::value,                          \
+                      "LOGB_TAG: the tag must be a string literal");                                                                                           \
+        if (static_cast<int>(static_cast<AixLog::Severity>(SEVERITY_)) >= static_cast<int>(AIXLOG_MIN_SEVERITY))                                               \
+        {                                                                                                                                                      \
+            AixLog::CallSite& aixlog_call_site_ = AIXLOG_INTERNAL__CALL_SITE(SEVERITY_, TAG_);                                                                 \
+            if (aixlog_call_site_.enabled(static_cast<AixLog::Severity>(SEVERITY_)))                                                                           \
+                AixLog::Log::log_binary(aixlog_call_site_, static_cast<AixLog::Severity>(SEVERITY_), __VA_ARGS__);                                             \
+        }                                                                                                                                                      \
+    } while (false)
+
 #define FUNC AixLog::Function(AIXLOG_INTERNAL__FUNC, __FILE__, __LINE__)
+// what LOG passes on as function, without copying the strings
+#define AIXLOG_INTERNAL__LOCATION AixLog::SourceLocation(AIXLOG_INTERNAL__FUNC, __FILE__, __LINE__)
 #define TAG AixLog::Tag
+#define FIELD AixLog::Field
 #define COND AixLog::Conditional
+
+// Limiters of a LOG statement, e.g. LOG(ERROR) << RATE_LIMIT(10) << "disk full\n". Every statement has its own, see Limiter.
+// usage: RATE_LIMIT(PER_SECOND) or RATE_LIMIT(PER_SECOND, BURST), EVERY_N(N), SAMPLED(PROBABILITY)
+// The lambda's unique type gives every statement its own static limiter.
+#define RATE_LIMIT(...) AixLog::Limiter::at_call_site<AixLog::RateLimit>([] {}, __VA_ARGS__)
+#define EVERY_N(N_) AixLog::Limiter::at_call_site<AixLog::EveryN>([] {}, N_)
+#define SAMPLED(PROBABILITY_) AixLog::Limiter::at_call_site<AixLog::Sample>([] {}, PROBABILITY_)
 #define TIMESTAMP AixLog::Timestamp(std::chrono::system_clock::now())
 
 
@@ -122,7 +236,7 @@
 #define FUNC_RECOMPOSER(argsWithParentheses) FUNC_CHOOSER argsWithParentheses
 #define CHOOSE_FROM_ARG_COUNT(...) FUNC_RECOMPOSER((__VA_ARGS__, LOG_2, LOG_1, FUNC_, ...))
 #define MACRO_CHOOSER(...) CHOOSE_FROM_ARG_COUNT(__VA_ARGS__())
-#define LOG(...) MACRO_CHOOSER(__VA_ARGS__)(__VA_ARGS__) << TIMESTAMP << FUNC
+#define LOG(...) MACRO_CHOOSER(__VA_ARGS__)(__VA_ARGS__) << TIMESTAMP << AIXLOG_INTERNAL__LOCATION
 #endif
 
 /**
@@ -263,6 +377,17 @@ struct TextColor
     Color background;
 };
 
+/**
+ * @brief
+ * Turns the ostream of a LOG statement into void, see AIXLOG_INTERNAL__LOG_IF
+ */
+struct Voidify
+{
+    void operator&(std::ostream&)
+    {
+    }
+};
+
 /**
  * @brief
  * For Conditional logging of a log line
@@ -271,15 +396,16 @@ struct Conditional
 {
     using EvalFunc = std::function<bool()>;
 
-    Conditional() : func_([](void) { return true; })
+    Conditional() : value_(true)
     {
     }
 
-    Conditional(const EvalFunc& func) : func_(func)
+    Conditional(const EvalFunc& func) : func_(func), value_(true)
     {
     }
 
-    Conditional(bool value) : func_([value](void) { return value; })
+    /// plain value, no std::function involved
+    Conditional(bool value) : value_(value)
     {
     }
 
@@ -287,11 +413,12 @@ struct Conditional
 
     virtual bool is_true() const
     {
-        return func_();
+        return func_ ? func_() : value_;
     }
 
 protected:
     EvalFunc func_;
+    bool value_;
 };
 
 /**
@@ -327,23 +454,77 @@ struct Timestamp
         return !is_null_;
     }
 
-    /// strftime format + proprietary "#ms" for milliseconds
+    /// strftime format + proprietary "#ms", "#us", "#ns" for the milli-, micro- and nanoseconds part
     std::string to_string(const std::string& format = "%Y-%m-%d %H-%M-%S.#ms") const
     {
-        std::time_t now_c = std::chrono::system_clock::to_time_t(time_point);
-        struct ::tm now_tm = localtime_xp(now_c);
-        char buffer[256];
-        strftime(buffer, sizeof buffer, format.c_str(), &now_tm);
-        std::string result(buffer);
-        size_t pos = result.find("#ms");
-        if (pos != std::string::npos)
+        std::string result;
+        append_to(result, format);
+        return result;
+    }
+
+    /// Same as "to_string", but appends to "result", which will not allocate if its capacity suffices.
+    /// The strftime output is cached per thread and second, only the sub-second digits are patched in.
+    void append_to(std::string& result, const std::string& format) const
+    {
+        long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(time_point.time_since_epoch()).count();
+        long long second = ns / 1000000000;
+        long long fraction = ns % 1000000000;
+        if (fraction < 0)
         {
-            int ms_part = std::chrono::time_point_cast<std::chrono::milliseconds>(time_point).time_since_epoch().count() % 1000;
-            char ms_str[4];
-            if (snprintf(ms_str, 4, "%03d", ms_part) >= 0)
-                result.replace(pos, 3, ms_str);
+            fraction += 1000000000;
+            --second;
         }
-        return result;
+
+        unsigned generation = cache_generation().load(std::memory_order_relaxed);
+        Cache& cache = thread_cache();
+        CacheEntry* entry = nullptr;
+        for (auto& e : cache.entries)
+        {
+            if ((e.second == second) && (e.generation == generation) && (e.format_len == format.size()) &&
+                (format.compare(0, std::string::npos, e.format, e.format_len) == 0))
+            {
+                entry = &e;
+                break;
+            }
+        }
+
+        CacheEntry uncached;
+        if (entry == nullptr)
+        {
+            if (format.size() < sizeof(CacheEntry::format))
+            {
+                entry = &cache.entries[cache.next];
+                cache.next = (cache.next + 1) % (sizeof(cache.entries) / sizeof(cache.entries[0]));
+            }
+            else
+            {
+                entry = &uncached;
+            }
+            fill(*entry, second, generation, format);
+        }
+
+        // copy the cached text, with the placeholders replaced by the sub-second digits
+        size_t pos = 0;
+        for (size_t n = 0; n < entry->fraction_count; ++n)
+        {
+            const Fraction& f = entry->fractions[n];
+            char digits[9];
+            long long value = fraction;
+            for (int i = 9; i > f.digits; --i)
+                value /= 10;
+            for (int i = f.digits - 1; i >= 0; --i, value /= 10)
+                digits[i] = static_cast<char>('0' + value % 10);
+            result.append(entry->text + pos, f.pos - pos).append(digits, static_cast<size_t>(f.digits));
+            pos = f.pos + 3;
+        }
+        result.append(entry->text + pos, entry->text_len - pos);
+    }
+
+    /// The formatted date and time is cached per thread and second.
+    /// Call this after changing the time zone at runtime (e.g. setting "TZ" and calling tzset).
+    static void invalidate_cache()
+    {
+        cache_generation().fetch_add(1);
     }
 
     time_point_sys_clock time_point;
@@ -351,7 +532,72 @@ struct Timestamp
 private:
     bool is_null_;
 
-    inline std::tm localtime_xp(std::time_t timer) const
+    /// Position of a "#ms", "#us" or "#ns" placeholder in the strftime output
+    struct Fraction
+    {
+        size_t pos;
+        int digits;
+    };
+
+    /// Trivially destructible, so that it can live in a thread_local that is never torn down
+    struct CacheEntry
+    {
+        long long second;
+        unsigned generation;
+        char format[64];
+        size_t format_len;
+        char text[256];
+        size_t text_len;
+        Fraction fractions[4];
+        size_t fraction_count;
+    };
+
+    struct Cache
+    {
+        CacheEntry entries[4];
+        size_t next;
+    };
+
+    static Cache& thread_cache()
+    {
+        // zero initialized: the entries are valid for an empty format at second 0
+        static thread_local Cache cache;
+        return cache;
+    }
+
+    static std::atomic<unsigned>& cache_generation()
+    {
+        static std::atomic<unsigned> generation(0);
+        return generation;
+    }
+
+    static void fill(CacheEntry& entry, long long second, unsigned generation, const std::string& format)
+    {
+        entry.second = second;
+        entry.generation = generation;
+        entry.format_len = format.copy(entry.format, sizeof(entry.format));
+        struct ::tm now_tm = localtime_xp(static_cast<std::time_t>(second));
+        entry.text_len = strftime(entry.text, sizeof(entry.text), format.c_str(), &now_tm);
+        entry.fraction_count = 0;
+        for (size_t pos = 0; pos + 3 <= entry.text_len; ++pos)
+        {
+            if (entry.text[pos] != '#')
+                continue;
+            int digits = 0;
+            if (std::strncmp(entry.text + pos, "#ms", 3) == 0)
+                digits = 3;
+            else if (std::strncmp(entry.text + pos, "#us", 3) == 0)
+                digits = 6;
+            else if (std::strncmp(entry.text + pos, "#ns", 3) == 0)
+                digits = 9;
+            if ((digits == 0) || (entry.fraction_count == sizeof(entry.fractions) / sizeof(entry.fractions[0])))
+                continue;
+            entry.fractions[entry.fraction_count++] = {pos, digits};
+            pos += 2;
+        }
+    }
+
+    static std::tm localtime_xp(std::time_t timer)
     {
         std::tm bt;
 #if defined(__unix__)
@@ -367,13 +613,18 @@ private:
     }
 };
 
+/// Ids of the empty tag, of "*" and of all tags that are not interned, see Tag and Filter
+static const size_t tag_id_empty = 0;
+static const size_t tag_id_all = 1;
+static const size_t tag_id_unknown = 2;
+
 /**
  * @brief
  * Tag (string) for log line
  */
 struct Tag
 {
-    Tag(std::nullptr_t) : text(""), is_null_(true)
+    Tag(std::nullptr_t) : text(""), id(tag_id_empty), is_null_(true)
     {
     }
 
@@ -381,15 +632,15 @@ struct Tag
     {
     }
 
-    Tag(const char* text) : text(text), is_null_(false)
+    Tag(const char* text) : text(text), id(find(this->text)), is_null_(false)
     {
     }
 
-    Tag(const std::string& text) : text(text), is_null_(false)
+    Tag(const std::string& text) : text(text), id(find(this->text)), is_null_(false)
     {
     }
 
-    Tag(std::string&& text) : text(std::move(text)), is_null_(false)
+    Tag(std::string&& text) : text(std::move(text)), id(find(this->text)), is_null_(false)
     {
     }
 
@@ -406,9 +657,173 @@ struct Tag
     }
 
     std::string text;
+    /// Small number that identifies the text, used e.g. by Filter as index. The empty (and null) tag is 0, "*" is 1.
+    /// Only texts that are interned have an own id, all others share "tag_id_unknown".
+    size_t id;
+
+    /// A tag's id, and its text as stored in the table of tags, i.e. valid until the process ends
+    struct Interned
+    {
+        size_t id;
+        const char* text;
+    };
+
+    /// Add "text" to the table of tags, if it's not in yet. Tags are never removed, so this is only done for
+    /// the tags of filters and of call sites, not for every tag that is logged.
+    static Interned intern(const std::string& text)
+    {
+        return table().insert(text);
+    }
+
+    /// @return the id of an interned "text", or "tag_id_unknown". Lock-free, unless more than 3072 tags are interned.
+    static size_t find(const std::string& text)
+    {
+        return table().lookup(text);
+    }
+
+    /// @return the text of an interned tag, or nullptr for the empty tag and the ids without an own text.
+    /// Searches the whole table, for the rare lines that only know a tag's id, e.g. the summaries of Limiter.
+    static const char* text_of(size_t id)
+    {
+        return table().text(id);
+    }
 
 private:
     bool is_null_;
+
+    struct Slot
+    {
+        /// published with release semantics after "id" is set
+        std::atomic<const std::string*> text;
+        size_t id;
+    };
+
+    /// Append-only open addressing table, only new tags take a lock
+    struct Table
+    {
+        enum : size_t
+        {
+            capacity = 4096
+        };
+
+        Table() : count(0), overflowed(false)
+        {
+            for (auto& slot : slots)
+                slot.text.store(nullptr, std::memory_order_relaxed);
+            insert("");
+            insert("*");
+            count = tag_id_unknown + 1;
+        }
+
+        static size_t hash(const std::string& text)
+        {
+            size_t result = 14695981039346656037ull;
+            for (char c : text)
+                result = (result ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+            return result;
+        }
+
+        /// @return the slot with "text" or nullptr. "empty" is set to the slot where "text" would be inserted.
+        const Slot* find(const std::string& text, size_t hash, Slot*& empty) const
+        {
+            empty = nullptr;
+            for (size_t n = 0; n < capacity; ++n)
+            {
+                const Slot& slot = slots[(hash + n) % capacity];
+                const std::string* slot_text = slot.text.load(std::memory_order_acquire);
+                if (slot_text == nullptr)
+                {
+                    empty = const_cast<Slot*>(&slot);
+                    return nullptr;
+                }
+                if (*slot_text == text)
+                    return &slot;
+            }
+            return nullptr;
+        }
+
+        size_t lookup(const std::string& text)
+        {
+            Slot* empty;
+            const Slot* slot = find(text, hash(text), empty);
+            if (slot != nullptr)
+                return slot->id;
+            if (!overflowed.load(std::memory_order_acquire))
+                return tag_id_unknown;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            auto iter = overflow.find(text);
+            return (iter != overflow.end()) ? iter->second : tag_id_unknown;
+        }
+
+        const char* text(size_t id)
+        {
+            if ((id == tag_id_empty) || (id == tag_id_unknown))
+                return nullptr;
+            for (const auto& slot : slots)
+            {
+                const std::string* slot_text = slot.text.load(std::memory_order_acquire);
+                if ((slot_text != nullptr) && (slot.id == id))
+                    return slot_text->c_str();
+            }
+            if (!overflowed.load(std::memory_order_acquire))
+                return nullptr;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            for (const auto& entry : overflow)
+            {
+                if (entry.second == id)
+                    return entry.first.c_str();
+            }
+            return nullptr;
+        }
+
+        Interned insert(const std::string& text)
+        {
+            size_t text_hash = hash(text);
+            Slot* empty;
+            const Slot* slot = find(text, text_hash, empty);
+            if (slot != nullptr)
+                return interned(*slot);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            slot = find(text, text_hash, empty);
+            if (slot != nullptr)
+                return interned(*slot);
+
+            if ((empty != nullptr) && (count < capacity * 3 / 4))
+            {
+                empty->id = count++;
+                empty->text.store(new std::string(text), std::memory_order_release);
+                return interned(*empty);
+            }
+
+            auto iter = overflow.find(text);
+            if (iter == overflow.end())
+                iter = overflow.emplace(text, count++).first;
+            overflowed.store(true, std::memory_order_release);
+            return Interned{iter->second, iter->first.c_str()};
+        }
+
+        static Interned interned(const Slot& slot)
+        {
+            return Interned{slot.id, slot.text.load(std::memory_order_acquire)->c_str()};
+        }
+
+        Slot slots[capacity];
+        size_t count;
+        std::mutex mutex;
+        /// for tags that don't fit into "slots" anymore
+        std::map<std::string, size_t> overflow;
+        std::atomic<bool> overflowed;
+    };
+
+    static Table& table()
+    {
+        // never destroyed, tags might be used up to the very end
+        static Table& table = *new Table();
+        return table;
+    }
 };
 
 /**
@@ -450,685 +865,5100 @@ private:
 
 /**
  * @brief
- * Collection of a log line's meta data
+ * Function, file and line of a LOG statement as static strings
+ *
+ * Streamed by LOG instead of a Function, so that the strings are not copied for every line.
+ * Metadata::function is filled from it only if a sink asks for the Metadata, see RecordView.
  */
-struct Metadata
+struct SourceLocation
 {
-    Metadata() : severity(Severity::trace), tag(nullptr), function(nullptr), timestamp(nullptr)
+    SourceLocation() : function(nullptr), file(nullptr), line(0)
     {
     }
 
-    Severity severity;
-    Tag tag;
-    Function function;
-    Timestamp timestamp;
-};
+    SourceLocation(const char* function, const char* file, size_t line) : function(function), file(file), line(line)
+    {
+    }
 
+    const char* function;
+    const char* file;
+    size_t line;
+};
 
-class Filter
+/**
+ * @brief
+ * A typed key/value pair of a log line, see Metadata::fields
+ *
+ * e.g.: LOG(INFO) << FIELD("user", name) << FIELD("attempts", n) << "login failed\n"
+ * The key must be a string literal. Numbers and string literals are stored without allocation, other strings are copied.
+ * A string literal value is only referenced while the line is dispatched, copies that are kept longer own it (see Metadata::own_fields).
+ */
+struct Field
 {
-public:
-    Filter()
+    enum class Type : std::uint8_t
+    {
+        boolean,
+        integer,
+        unsigned_integer,
+        floating_point,
+        literal,
+        string
+    };
+
+    Field(const char* key, bool value) : key(key), type(Type::boolean)
     {
+        this->value.boolean = value;
     }
 
-    Filter(Severity severity)
+    template <typename T, typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value, int>::type = 0>
+    Field(const char* key, T value) : key(key), type(Type::integer)
     {
-        add_filter(severity);
+        this->value.integer = value;
     }
 
-    bool match(const Metadata& metadata) const
+    template <typename T, typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value && !std::is_same<T, bool>::value, int>::type = 0>
+    Field(const char* key, T value) : key(key), type(Type::unsigned_integer)
     {
-        if (tag_filter_.empty())
-            return true;
+        this->value.unsigned_integer = value;
+    }
 
-        auto iter = tag_filter_.find(metadata.tag);
-        if (iter != tag_filter_.end())
-            return (metadata.severity >= iter->second);
+    template <typename T, typename std::enable_if<std::is_floating_point<T>::value, int>::type = 0>
+    Field(const char* key, T value) : key(key), type(Type::floating_point)
+    {
+        this->value.floating_point = static_cast<double>(value);
+    }
 
-        iter = tag_filter_.find("*");
-        if (iter != tag_filter_.end())
-            return (metadata.severity >= iter->second);
+    template <size_t N>
+    Field(const char* key, const char (&value)[N]) : key(key), type(Type::literal)
+    {
+        this->value.literal = value;
+    }
 
-        return false;
+    template <size_t N>
+    Field(const char* key, char (&value)[N]) : Field(key, std::string(value))
+    {
     }
 
-    void add_filter(const Tag& tag, Severity severity)
+    template <typename T, typename std::enable_if<std::is_same<T, const char*>::value || std::is_same<T, char*>::value, int>::type = 0>
+    Field(const char* key, T value) : Field(key, std::string((value != nullptr) ? value : "(null)"))
     {
-        tag_filter_[tag] = severity;
     }
 
-    void add_filter(Severity severity)
+    Field(const char* key, std::string value) : key(key), type(Type::string), string(std::move(value))
     {
-        tag_filter_["*"] = severity;
     }
 
-    void add_filter(const std::string& filter)
+    /// Append the value as text, strings without quotes
+    void append_value(std::string& text) const;
+
+    /// Copy a Type::literal value into "string", for a field that is kept beyond its LOG statement.
+    /// Type::literal is any const char array, which is not necessarily a string literal.
+    void own_value()
     {
-        auto pos = filter.find(":");
-        if (pos != std::string::npos)
-            add_filter(filter.substr(0, pos), to_severity(filter.substr(pos + 1)));
-        else
-            add_filter(to_severity(filter));
+        if (type != Type::literal)
+            return;
+        string.assign(value.literal);
+        type = Type::string;
     }
 
-private:
-    std::map<Tag, Severity> tag_filter_;
+    const char* key;
+    Type type;
+    union
+    {
+        bool boolean;
+        std::int64_t integer;
+        std::uint64_t unsigned_integer;
+        double floating_point;
+        const char* literal;
+    } value;
+    /// the value of Type::string
+    std::string string;
 };
 
-
 /**
  * @brief
- * Abstract log sink
- *
- * All log sinks must inherit from this Sink
+ * Collection of a log line's meta data
  */
-struct Sink
+struct Metadata
 {
-    Sink(const Filter& filter) : filter(filter)
+    Metadata() : severity(Severity::trace), tag(nullptr), function(nullptr), timestamp(nullptr)
     {
     }
 
-    virtual ~Sink() = default;
-
-    virtual void log(const Metadata& metadata, const std::string& message) = 0;
+    /// Copy the values that point into the LOG statement, call it on a copy that is kept beyond it, see Field::own_value
+    void own_fields()
+    {
+        for (auto& field : fields)
+            field.own_value();
+    }
 
-    Filter filter;
+    Severity severity;
+    Tag tag;
+    Function function;
+    Timestamp timestamp;
+    /// Key/value pairs in the order they were logged
+    std::vector<Field> fields;
 };
 
-/// ostream operators << for the meta data structs
-static std::ostream& operator<<(std::ostream& os, const Severity& log_severity);
-static std::ostream& operator<<(std::ostream& os, const Timestamp& timestamp);
-static std::ostream& operator<<(std::ostream& os, const Tag& tag);
-static std::ostream& operator<<(std::ostream& os, const Function& function);
-static std::ostream& operator<<(std::ostream& os, const Conditional& conditional);
-static std::ostream& operator<<(std::ostream& os, const Color& color);
-static std::ostream& operator<<(std::ostream& os, const TextColor& text_color);
-
-using log_sink_ptr = std::shared_ptr<Sink>;
-
 /**
  * @brief
- * Main Logger class with "Log::init"
+ * A log line as it's passed to Sink::log_record, without copying it
  *
- * Don't use it directly, but call once "Log::init" with your log sink instances.
- * The Log class will simply redirect clog to itself (as a streambuf) and
- * forward whatever went to clog to the log sink instances
+ * The texts point into the logging thread's buffers and into the static data of the LOG statement. They are only
+ * valid during the call and not null terminated. "metadata" and "message" provide the line as Metadata and string,
+ * for sinks that need them: the Metadata is completed on first use, in the thread's reused buffers.
  */
-class Log : public std::basic_streambuf<char, std::char_traits<char>>
+struct RecordView
 {
-public:
-    static Log& instance()
-    {
-        static Log instance_;
-        return instance_;
-    }
-
-    /// Without "init" every LOG(X) will simply go to clog
-    static void init(const std::vector<log_sink_ptr> log_sinks = {})
+    /// A string that is not owned. Null (false) for a missing tag or function, in contrast to an empty one.
+    struct Text
     {
-        Log::instance().log_sinks_.clear();
+        Text() : data(nullptr), size(0)
+        {
+        }
 
-        for (const auto& sink : log_sinks)
-            Log::instance().add_logsink(sink);
-    }
+        Text(const char* data, size_t size) : data(data), size(size)
+        {
+        }
 
-    template <typename T, typename... Ts>
-    static std::shared_ptr<T> init(Ts&&... params)
-    {
-        std::shared_ptr<T> sink = Log::instance().add_logsink<T>(std::forward<Ts>(params)...);
-        init({sink});
-        return sink;
-    }
+        explicit Text(const char* text) : data(text), size((text != nullptr) ? std::strlen(text) : 0)
+        {
+        }
 
-    template <typename T, typename... Ts>
-    std::shared_ptr<T> add_logsink(Ts&&... params)
-    {
-        std::lock_guard<std::recursive_mutex> lock(mutex_);
-        static_assert(std::is_base_of<Sink, typename std::decay<T>::type>::value, "type T must be a Sink");
-        std::shared_ptr<T> sink = std::make_shared<T>(std::forward<Ts>(params)...);
-        log_sinks_.push_back(sink);
-        return sink;
-    }
+        explicit Text(const std::string& text) : data(text.data()), size(text.size())
+        {
+        }
 
-    void add_logsink(const log_sink_ptr& sink)
-    {
-        std::lock_guard<std::recursive_mutex> lock(mutex_);
-        log_sinks_.push_back(sink);
-    }
+        explicit operator bool() const
+        {
+            return data != nullptr;
+        }
 
-    void remove_logsink(const log_sink_ptr& sink)
-    {
-        std::lock_guard<std::recursive_mutex> lock(mutex_);
-        log_sinks_.erase(std::remove(log_sinks_.begin(), log_sinks_.end(), sink), log_sinks_.end());
-    }
+        const char* data;
+        size_t size;
+    };
 
-protected:
-    Log() noexcept : last_buffer_(nullptr), do_log_(true)
+    RecordView(const Metadata& metadata, const std::string& message)
+        : severity(metadata.severity), timestamp(metadata.timestamp), tag(metadata.tag ? Text(metadata.tag.text) : Text()), tag_id(metadata.tag.id),
+          function(metadata.function ? Text(metadata.function.name) : Text()), file(metadata.function ? Text(metadata.function.file) : Text()),
+          line(metadata.function.line), text(message), fields(metadata.fields.data()), fields_size(metadata.fields.size()), metadata_(&metadata),
+          message_(message), location_metadata_(nullptr)
     {
-        std::clog.rdbuf(this);
-        std::clog << Severity() << Tag() << Function() << Conditional() << AixLog::Color::NONE << std::flush;
     }
 
-    virtual ~Log()
+    /// A line whose function is "location", and not yet in "metadata"
+    RecordView(Metadata& metadata, const std::string& message, const SourceLocation& location) : RecordView(metadata, message)
     {
-        sync();
+        function = Text(location.function);
+        file = Text(location.file);
+        line = location.line;
+        location_metadata_ = &metadata;
     }
 
-    int sync() override
+    const Metadata& metadata() const
     {
-        std::lock_guard<std::recursive_mutex> lock(mutex_);
-        if (!get_stream().str().empty())
+        if (location_metadata_ != nullptr)
         {
-            if (do_log_)
+            Function& target = location_metadata_->function;
+            if (target)
             {
-                for (const auto& sink : log_sinks_)
-                {
-                    if (sink->filter.match(metadata_))
-                        sink->log(metadata_, get_stream().str());
-                }
+                target.name.assign(function.data, function.size);
+                target.file.assign(file.data, file.size);
+                target.line = line;
+            }
+            else
+            {
+                target = Function(std::string(function.data, function.size), std::string(file.data, file.size), line);
             }
-            get_stream().str("");
-            get_stream().clear();
+            location_metadata_ = nullptr;
         }
-
-        return 0;
+        return *metadata_;
     }
 
-    int overflow(int c) override
+    const std::string& message() const
     {
-        std::lock_guard<std::recursive_mutex> lock(mutex_);
-        if (c != EOF)
-        {
-            if (c == '\n')
-                sync();
-            else if (do_log_)
-                get_stream() << static_cast<char>(c);
-        }
-        else
-        {
-            sync();
-        }
-        return c;
+        return message_;
     }
 
-private:
-    friend std::ostream& operator<<(std::ostream& os, const Severity& log_severity);
-    friend std::ostream& operator<<(std::ostream& os, const Timestamp& timestamp);
-    friend std::ostream& operator<<(std::ostream& os, const Tag& tag);
-    friend std::ostream& operator<<(std::ostream& os, const Function& function);
-    friend std::ostream& operator<<(std::ostream& os, const Conditional& conditional);
+    Severity severity;
+    Timestamp timestamp;
+    Text tag;
+    /// see Tag::id
+    size_t tag_id;
+    Text function;
+    Text file;
+    size_t line;
+    /// the message
+    Text text;
+    const Field* fields;
+    size_t fields_size;
 
-    std::stringstream& get_stream()
-    {
-        auto id = std::this_thread::get_id();
-        if ((last_buffer_ == nullptr) || (last_id_ != id))
-        {
-            last_id_ = id;
-            last_buffer_ = &(buffer_[id]);
-        }
-        return *last_buffer_;
-    }
+private:
+    friend class Log;
 
-    /// one buffer per thread to avoid mixed log lines
-    std::map<std::thread::id, std::stringstream> buffer_;
-    /// the last thread id
-    std::thread::id last_id_;
-    /// the last buffer
-    std::stringstream* last_buffer_ = nullptr;
-    Metadata metadata_;
-    bool do_log_;
-    std::vector<log_sink_ptr> log_sinks_;
-    std::recursive_mutex mutex_;
+    const Metadata* metadata_;
+    const std::string& message_;
+    /// "metadata_", as long as its function still has to be set from the location
+    mutable Metadata* location_metadata_;
 };
 
+class Scope;
+
 /**
  * @brief
- * Null log sink
- *
- * Discards all log messages
+ * A log line that is currently composed by a thread
  */
-struct SinkNull : public Sink
+struct Record
 {
-    SinkNull() : Sink(Filter())
+    /// A line that is held back by a Scope
+    struct Line
     {
-    }
+        Metadata metadata;
+        std::string message;
+    };
 
-    void log(const Metadata& /*metadata*/, const std::string& /*message*/) override
+    /// A log line rendered by a sink, shared with other sinks that would render it the same way
+    struct Rendered
+    {
+        Rendered() : dispatch_id(0), metadata(nullptr), message(nullptr)
+        {
+        }
+
+        /// every line that Log dispatches, or that a sink makes up meanwhile (see Log::own_line), has its own id
+        std::uint64_t dispatch_id;
+        /// tell apart the lines of a batch, which share the dispatch id and are all alive during the dispatch
+        const Metadata* metadata;
+        const char* message;
+        /// what the line was rendered with, e.g. the format
+        std::string key;
+        std::string line;
+    };
+
+    Record() : location_pending(false), do_log(true), dispatch_id(0), dispatch_count(0), next_rendered(0), formatting(false), scope(nullptr)
     {
     }
+
+    Metadata metadata;
+    std::string message;
+    /// The function of the line, if it was streamed as SourceLocation and "metadata.function" isn't set from it yet
+    SourceLocation location;
+    bool location_pending;
+    bool do_log;
+    /// Identifies the log line that the thread is currently passing to the sinks, 0 if none
+    std::uint64_t dispatch_id;
+    std::uint64_t dispatch_count;
+    Rendered rendered[4];
+    size_t next_rendered;
+    /// Arguments of a LOGB line, see Log::log_binary
+    std::string binary;
+    /// A LOGF line, see Log::log_format. Reused, so that it's not allocated for every line.
+    Metadata format_metadata;
+    std::string format_message;
+    /// "format_metadata" and "format_message" are in use
+    bool formatting;
+    /// The innermost Scope of the thread, or nullptr
+    Scope* scope;
+    /// Buffers of ended scopes, reused by the next ones
+    std::vector<std::vector<Line>> scope_buffers;
+    /// The lines of a batch that pass a sink's filter, see Log::dispatch. Taken while in use, so a nested batch gets its own.
+    std::vector<RecordView> batch;
+    /// The lines of a failed Scope, see Scope::fail. Taken while in use, like "batch".
+    std::vector<RecordView> scope_lines;
 };
 
 
 /**
  * @brief
- * Abstract log sink with support for formatting log message
+ * Lets only some of many log lines through, lock-free and thread safe
  *
- * "format" in the c'tor defines a log pattern.
- * For every log message, these placeholders will be substituded:
- * - strftime syntax is used to format the logging time stamp (%Y, %m, %d, ...)
- * - #ms: milliseconds part of the logging time stamp with leading zeros
- * - #severity: log severity
- * - #tag_func: the log tag. If empty, the function
- * - #tag: the log tag
- * - #function: the function
- * - #message: the log message
+ * Attached to a LOG statement, e.g. LOG(ERROR) << RATE_LIMIT(10) << "disk full\n", or to a tag in a Filter.
+ * Suppressed lines are counted. The next line that passes is preceded by a summary line "suppressed K messages",
+ * with the count also as field "suppressed". Counts that no line follows are summarized by Log::flush and at exit.
  */
-struct SinkFormat : public Sink
+struct Limiter
 {
-    SinkFormat(const Filter& filter, const std::string& format) : Sink(filter), format_(format)
+    Limiter() : suppressed_(0), severity_(static_cast<int>(Severity::trace)), tag_id_(tag_id_empty), next_call_site_(nullptr)
     {
     }
 
-    virtual void set_format(const std::string& format)
+    virtual ~Limiter() = default;
+
+    /// @return true if the line passes, otherwise it's counted as suppressed
+    bool allow()
     {
-        format_ = format;
+        if (admit())
+            return true;
+        suppressed_.fetch_add(1, std::memory_order_relaxed);
+        return false;
     }
 
-    void log(const Metadata& metadata, const std::string& message) override = 0;
+    /// Like "allow", a suppressed line's severity and tag id are kept for a summary without a following line
+    bool allow(Severity severity, size_t tag_id)
+    {
+        if (admit())
+            return true;
+        severity_.store(static_cast<int>(severity), std::memory_order_relaxed);
+        tag_id_.store(tag_id, std::memory_order_relaxed);
+        suppressed_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
 
-protected:
-    virtual void do_log(std::ostream& stream, const Metadata& metadata, const std::string& message) const
+    /// Severity of the last suppressed line
+    Severity severity() const
     {
-        std::string result = format_;
-        if (metadata.timestamp)
-            result = metadata.timestamp.to_string(result);
+        return static_cast<Severity>(severity_.load(std::memory_order_relaxed));
+    }
 
-        size_t pos = result.find("#severity");
-        if (pos != std::string::npos)
-            result.replace(pos, 9, to_string(metadata.severity));
+    /// Tag id of the last suppressed line, see Tag::text_of
+    size_t tag_id() const
+    {
+        return tag_id_.load(std::memory_order_relaxed);
+    }
 
-        pos = result.find("#color_severity");
-        if (pos != std::string::npos)
-        {
-            std::stringstream ss;
-            ss << TextColor(Color::RED) << to_string(metadata.severity) << TextColor(Color::NONE);
-            result.replace(pos, 15, ss.str());
-        }
+    /// @return number of lines suppressed since the last call
+    std::uint64_t take_suppressed()
+    {
+        if (suppressed_.load(std::memory_order_relaxed) == 0)
+            return 0;
+        return suppressed_.exchange(0, std::memory_order_relaxed);
+    }
 
-        pos = result.find("#tag_func");
-        if (pos != std::string::npos)
-            result.replace(pos, 9, metadata.tag ? metadata.tag.text : (metadata.function ? metadata.function.name : "log"));
+    /// @return a limiter with the same settings, but in initial state
+    virtual std::unique_ptr<Limiter> clone() const = 0;
 
-        pos = result.find("#tag");
-        if (pos != std::string::npos)
-            result.replace(pos, 4, metadata.tag ? metadata.tag.text : "");
+    /// The limiter of a LOG statement, created with "args" on first use, see RATE_LIMIT
+    template <typename T, typename Unique, typename... Args>
+    static T& at_call_site(Unique /*unique*/, Args... args)
+    {
+        // never destroyed, Log summarizes its count at exit
+        static T& limiter = registered(*new T(args...));
+        return limiter;
+    }
 
-        pos = result.find("#function");
-        if (pos != std::string::npos)
-            result.replace(pos, 9, metadata.function ? metadata.function.name : "");
+    /// @return the most recently created limiter of a LOG statement
+    static Limiter* first_call_site()
+    {
+        return call_sites().load(std::memory_order_acquire);
+    }
 
-        pos = result.find("#message");
-        if (pos != std::string::npos)
-        {
-            result.replace(pos, 8, message);
-            stream << result << std::endl;
-        }
-        else
+    Limiter* next_call_site() const
+    {
+        return next_call_site_;
+    }
+
+protected:
+    virtual bool admit() = 0;
+
+    /// "value" as a positive integer, NaN is 0 and large values are "max"
+    template <typename T>
+    static T clamp(double value, T max)
+    {
+        if (!(value > 0))
+            return 0;
+        return (value < static_cast<double>(max)) ? static_cast<T>(value) : max;
+    }
+
+private:
+    template <typename T>
+    static T& registered(T& limiter)
+    {
+        limiter.next_call_site_ = first_call_site();
+        while (!call_sites().compare_exchange_weak(limiter.next_call_site_, &limiter))
         {
-            if (result.empty() || (result.back() == ' '))
-                stream << result << message << std::endl;
-            else
-                stream << result << " " << message << std::endl;
         }
+        return limiter;
+    }
+
+    static std::atomic<Limiter*>& call_sites()
+    {
+        static std::atomic<Limiter*> limiter(nullptr);
+        return limiter;
     }
 
-    std::string format_;
+    std::atomic<std::uint64_t> suppressed_;
+    std::atomic<int> severity_;
+    std::atomic<size_t> tag_id_;
+    Limiter* next_call_site_;
 };
 
 /**
  * @brief
- * Formatted logging to cout
+ * At most "per_second" lines per second, on average, with bursts of up to "burst" lines
+ *
+ * A token bucket, implemented as "generic cell rate algorithm": a single atomic time stamp
+ * that is advanced by 1/per_second for every line that passes.
  */
-struct SinkCout : public SinkFormat
+struct RateLimit : public Limiter
 {
-    SinkCout(const Filter& filter, const std::string& format = "%Y-%m-%d %H-%M-%S.#ms [#severity] (#tag_func)") : SinkFormat(filter, format)
+    /// @param burst lines that may pass at once after a quiet period, 0: "per_second", but at least 1
+    RateLimit(double per_second, double burst = 0)
+        : per_second_(per_second), burst_((burst > 0) ? burst : std::max(per_second, 1.)),
+          interval_ns_((per_second > 0) ? clamp<std::int64_t>(1e9 / per_second, max_ns) : 0),
+          tolerance_ns_(clamp<std::int64_t>(static_cast<double>(interval_ns_) * (std::max(burst_, 1.) - 1), max_ns)), next_ns_(0)
     {
     }
 
-    void log(const Metadata& metadata, const std::string& message) override
+    std::unique_ptr<Limiter> clone() const override
     {
-        do_log(std::cout, metadata, message);
+        return std::unique_ptr<Limiter>(new RateLimit(per_second_, burst_));
+    }
+
+protected:
+    bool admit() override
+    {
+        if (interval_ns_ <= 0)
+            return per_second_ > 0;
+        std::int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        std::int64_t next = next_ns_.load(std::memory_order_relaxed);
+        do
+        {
+            if (next - tolerance_ns_ > now)
+                return false;
+        } while (!next_ns_.compare_exchange_weak(next, std::max(next, now) + interval_ns_, std::memory_order_relaxed));
+        return true;
     }
+
+private:
+    /// about 30 years, far from overflowing when added to a steady_clock time stamp
+    static const std::int64_t max_ns = 1000000000000000000ll;
+
+    double per_second_;
+    double burst_;
+    std::int64_t interval_ns_;
+    std::int64_t tolerance_ns_;
+    /// time at which the bucket is full again
+    std::atomic<std::int64_t> next_ns_;
 };
 
 /**
  * @brief
- * Formatted logging to cerr
+ * Every "n"th line passes, starting with the first
  */
-struct SinkCerr : public SinkFormat
+struct EveryN : public Limiter
 {
-    SinkCerr(const Filter& filter, const std::string& format = "%Y-%m-%d %H-%M-%S.#ms [#severity] (#tag_func)") : SinkFormat(filter, format)
+    EveryN(std::uint64_t n) : n_(std::max<std::uint64_t>(n, 1)), count_(0)
     {
     }
 
-    void log(const Metadata& metadata, const std::string& message) override
+    std::unique_ptr<Limiter> clone() const override
     {
-        do_log(std::cerr, metadata, message);
+        return std::unique_ptr<Limiter>(new EveryN(n_));
+    }
+
+protected:
+    bool admit() override
+    {
+        return count_.fetch_add(1, std::memory_order_relaxed) % n_ == 0;
     }
+
+private:
+    std::uint64_t n_;
+    std::atomic<std::uint64_t> count_;
 };
 
 /**
  * @brief
- * Formatted logging to file
+ * A line passes with the given probability (0..1), decided by a per thread pseudo random generator
  */
-struct SinkFile : public SinkFormat
+struct Sample : public Limiter
 {
-    SinkFile(const Filter& filter, const std::string& filename, const std::string& format = "%Y-%m-%d %H-%M-%S.#ms [#severity] (#tag_func)")
-        : SinkFormat(filter, format)
+    Sample(double probability)
+        : probability_(probability),
+          threshold_((probability >= 1) ? std::numeric_limits<std::uint64_t>::max()
+                                        : clamp<std::uint64_t>(probability * 18446744073709551616., std::numeric_limits<std::uint64_t>::max()))
     {
-        ofs.open(filename.c_str(), std::ofstream::out | std::ofstream::trunc);
     }
 
-    ~SinkFile() override
+    std::unique_ptr<Limiter> clone() const override
     {
-        ofs.close();
+        return std::unique_ptr<Limiter>(new Sample(probability_));
     }
 
-    void log(const Metadata& metadata, const std::string& message) override
+protected:
+    bool admit() override
     {
-        do_log(ofs, metadata, message);
+        return (threshold_ == std::numeric_limits<std::uint64_t>::max()) || (random() < threshold_);
     }
 
-protected:
-    mutable std::ofstream ofs;
+    /// splitmix64, seeded per thread
+    static std::uint64_t random()
+    {
+        static thread_local std::uint64_t state =
+            static_cast<std::uint64_t>(std::hash<std::thread::id>()(std::this_thread::get_id())) ^
+            static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+        std::uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+private:
+    double probability_;
+    std::uint64_t threshold_;
 };
 
-#ifdef _WIN32
+/// Called by the Filter of a sink in Log on changes, so that Log can update its summary of the sinks' filters
+static void on_filter_changed();
+
 /**
  * @brief
- * Windows: Logging to OutputDebugString
+ * Minimum severity and limiter per tag
  *
- * Not tested due to unavailability of Windows
+ * Changes of the filter of a sink that was passed to Log (including assigning a whole new filter)
+ * are published to the logging threads once per call. Other filters don't notify Log.
  */
-struct SinkOutputDebugString : public Sink
+class Filter
 {
-    SinkOutputDebugString(const Filter& filter) : Sink(filter)
+public:
+    Filter() : default_(all), has_default_(false)
     {
     }
 
-    void log(const Metadata& metadata, const std::string& message) override
+    Filter(Severity severity) : Filter()
     {
-#ifdef UNICODE
-        std::wstring wide = std::wstring(message.begin(), message.end());
-        OutputDebugString(wide.c_str());
-#else
-        OutputDebugString(message.c_str());
-#endif
+        add_filter(severity);
     }
-};
-#endif
 
-#ifdef HAS_APPLE_UNIFIED_LOG_
-/**
- * @brief
- * macOS: Logging to Apples system logger
- */
-struct SinkUnifiedLogging : public Sink
-{
-    SinkUnifiedLogging(const Filter& filter) : Sink(filter)
+    Filter(const Filter& other) = default;
+    Filter(Filter&& other) = default;
+
+    /// Takes over severities and limiters (clones of them) of "other", but stays registered with Log
+    Filter& operator=(const Filter& other)
     {
+        Change change(*this);
+        levels_ = other.levels_;
+        has_level_ = other.has_level_;
+        default_ = other.default_;
+        has_default_ = other.has_default_;
+        limits_ = other.limits_;
+        default_limit_ = other.default_limit_;
+        return *this;
     }
 
-    os_log_type_t get_os_log_type(Severity severity) const
+    bool match(const Metadata& metadata) const
     {
-        // https://developer.apple.com/documentation/os/os_log_type_t?language=objc
-        switch (severity)
+        return match(metadata.tag, metadata.severity);
+    }
+
+    /// A single lookup in a table indexed by the tag's id. Tags without own entry have the "*" severity (if any).
+    bool match(const Tag& tag, Severity severity) const
+    {
+        return match(tag.id, severity);
+    }
+
+    bool match(size_t tag_id, Severity severity) const
+    {
+        int level = (tag_id < levels_.size()) ? levels_[tag_id] : default_;
+        return static_cast<int>(severity) >= level;
+    }
+
+    /// The tag is interned, i.e. it gets an own id, see Tag
+    void add_filter(const Tag& tag, Severity severity)
+    {
+        Change change(*this);
+        size_t id = Tag::intern(tag.text).id;
+        if (id == tag_id_all)
         {
-            case Severity::trace:
-            case Severity::debug:
-                return OS_LOG_TYPE_DEBUG;
-            case Severity::info:
-            case Severity::notice:
-                return OS_LOG_TYPE_INFO;
-            case Severity::warning:
-                return OS_LOG_TYPE_DEFAULT;
-            case Severity::error:
-                return OS_LOG_TYPE_ERROR;
-            case Severity::fatal:
-                return OS_LOG_TYPE_FAULT;
-            default:
-                return OS_LOG_TYPE_DEFAULT;
+            add_filter(severity);
+            return;
+        }
+
+        if (!has_default_ && (default_ == all))
+            set_default(none);
+
+        if (id >= levels_.size())
+        {
+            levels_.resize(id + 1, default_);
+            has_level_.resize(id + 1, false);
         }
+        levels_[id] = static_cast<int>(severity);
+        has_level_[id] = true;
     }
 
-    void log(const Metadata& metadata, const std::string& message) override
+    void add_filter(Severity severity)
+    {
+        Change change(*this);
+        has_default_ = true;
+        set_default(static_cast<int>(severity));
+    }
+
+    /// Pass lines with "tag" (or "*": with any tag that has no own limiter) that match the filter only if "limiter" lets them.
+    /// Every filter has its own copy of the limiter, i.e. also every copy of this filter.
+    void add_limit(const Tag& tag, const Limiter& limiter)
+    {
+        Change change(*this);
+        size_t id = Tag::intern(tag.text).id;
+        if (id == tag_id_all)
+        {
+            default_limit_ = Limit(limiter.clone());
+        }
+        else
+        {
+            if (id >= limits_.size())
+                limits_.resize(id + 1);
+            limits_[id] = Limit(limiter.clone());
+        }
+    }
+
+    /// @return the limiter for lines with this tag, or nullptr
+    Limiter* limiter(size_t tag_id) const
+    {
+        if ((tag_id < limits_.size()) && limits_[tag_id].limiter)
+            return limits_[tag_id].limiter.get();
+        return default_limit_.limiter.get();
+    }
+
+    /// "<tag>:<severity>" or "<severity>", or a list of them separated by commas or white space, e.g. "*:WARNING,net:DEBUG"
+    void add_filter(const std::string& filter)
+    {
+        Change change(*this);
+        static const char* separators = ", \t\r\n";
+        if (filter.find_first_of(separators) != std::string::npos)
+        {
+            for (auto begin = filter.find_first_not_of(separators); begin != std::string::npos;)
+            {
+                auto end = filter.find_first_of(separators, begin);
+                add_filter(filter.substr(begin, (end == std::string::npos) ? end : end - begin));
+                begin = filter.find_first_not_of(separators, end);
+            }
+            return;
+        }
+
+        auto pos = filter.find(":");
+        if (pos != std::string::npos)
+            add_filter(filter.substr(0, pos), to_severity(filter.substr(pos + 1)));
+        else
+            add_filter(to_severity(filter));
+    }
+
+    /// Take over the severities of "other", but keep this filter's limiters
+    void set_levels(const Filter& other)
+    {
+        Change change(*this);
+        levels_ = other.levels_;
+        has_level_ = other.has_level_;
+        default_ = other.default_;
+        has_default_ = other.has_default_;
+    }
+
+    /// @return the lowest severity that matches for any tag
+    int min_severity() const
+    {
+        if (default_ == all)
+            return std::numeric_limits<std::int8_t>::min();
+
+        int result = has_default_ ? default_ : std::numeric_limits<int>::max();
+        for (size_t id = 0; id < levels_.size(); ++id)
+        {
+            if (has_level_[id])
+                result = std::min(result, levels_[id]);
+        }
+        return result;
+    }
+
+private:
+    /// "default_" of an empty filter: everything matches
+    static const int all = std::numeric_limits<int>::min();
+    /// "default_" of a filter with tags, but without "*": nothing else matches
+    static const int none = std::numeric_limits<int>::max();
+
+    void set_default(int level)
+    {
+        default_ = level;
+        for (size_t id = 0; id < levels_.size(); ++id)
+        {
+            if (!has_level_[id])
+                levels_[id] = level;
+        }
+    }
+
+    /// minimum severity per tag id, "*" folded in
+    std::vector<int> levels_;
+    /// tags with an own entry
+    std::vector<bool> has_level_;
+    /// minimum severity of tags that are not (yet) in "levels_"
+    int default_;
+    /// "*" is set
+    bool has_default_;
+
+    friend class Log;
+
+    /// How often the owning sink is in Log's sinks, and the nesting of the running changes.
+    /// A copied filter is not registered, an assigned one keeps its registration.
+    struct Registration
+    {
+        Registration() : sinks(0), changes(0)
+        {
+        }
+
+        Registration(const Registration& /*other*/) : Registration()
+        {
+        }
+
+        Registration& operator=(const Registration& /*other*/)
+        {
+            return *this;
+        }
+
+        std::atomic<size_t> sinks;
+        size_t changes;
+    };
+
+    /// Notifies Log when the outermost change of a registered filter is done
+    struct Change
+    {
+        explicit Change(Filter& filter) : filter(filter)
+        {
+            ++filter.registration_.changes;
+        }
+
+        ~Change()
+        {
+            if ((--filter.registration_.changes == 0) && (filter.registration_.sinks.load(std::memory_order_relaxed) > 0))
+                on_filter_changed();
+        }
+
+        Filter& filter;
+    };
+
+    Registration registration_;
+
+    /// A copy that shares the limiters with this filter, used for Log's snapshot of the sinks' filters
+    Filter shared_copy() const
+    {
+        Filter result(*this);
+        for (size_t id = 0; id < limits_.size(); ++id)
+            result.limits_[id].limiter = limits_[id].limiter;
+        result.default_limit_.limiter = default_limit_.limiter;
+        return result;
+    }
+
+    /// Owns a limiter. Copies get a clone, so that sinks with a copy of the same filter don't share the state.
+    struct Limit
+    {
+        Limit() = default;
+
+        explicit Limit(std::unique_ptr<Limiter> limiter) : limiter(std::move(limiter))
+        {
+        }
+
+        Limit(const Limit& other) : limiter(other.limiter ? other.limiter->clone() : nullptr)
+        {
+        }
+
+        Limit(Limit&& other) = default;
+
+        Limit& operator=(const Limit& other)
+        {
+            limiter = other.limiter ? other.limiter->clone() : nullptr;
+            return *this;
+        }
+
+        Limit& operator=(Limit&& other) = default;
+
+        std::shared_ptr<Limiter> limiter;
+    };
+
+    /// limiter per tag id
+    std::vector<Limit> limits_;
+    /// limiter of "*"
+    Limit default_limit_;
+};
+
+
+struct BinaryRecord;
+
+/**
+ * @brief
+ * Runtime metrics of a sink, a snapshot of the counters that Log maintains while dispatching to it
+ *
+ * Lines that are skipped at their LOG statement because no sink would accept them are not counted.
+ * Reading the clock costs about as much as a fast sink, so only every "timing_sample"th line is timed.
+ */
+struct SinkMetrics
+{
+    enum : size_t
+    {
+        buckets = 32,
+        timing_sample = 8
+    };
+
+    SinkMetrics() : offered(0), filtered(0), written(0), bytes(0), dropped(0), log_time_ns(0)
+    {
+        std::fill(log_time_histogram, log_time_histogram + buckets, 0);
+    }
+
+    /// @return upper bound in ns of the time within which "fraction" (e.g. 0.99) of the timed "log" calls returned
+    std::uint64_t log_time_percentile(double fraction) const
+    {
+        std::uint64_t timed = 0;
+        for (auto count : log_time_histogram)
+            timed += count;
+        auto wanted = static_cast<std::uint64_t>(fraction * static_cast<double>(timed));
+        std::uint64_t count = 0;
+        for (size_t bucket = 0; bucket < buckets; ++bucket)
+        {
+            count += log_time_histogram[bucket];
+            if ((count > 0) && (count >= wanted))
+                return (std::uint64_t(2) << bucket) - 1;
+        }
+        return 0;
+    }
+
+    /// Lines that were passed to the sink's filter
+    std::uint64_t offered;
+    /// Lines that were rejected by the filter
+    std::uint64_t filtered;
+    /// Lines that were passed to "log"
+    std::uint64_t written;
+    /// Size of the messages that were passed to "log"
+    std::uint64_t bytes;
+    /// Lines that the sink discarded itself, e.g. SinkAsync with a full buffer
+    std::uint64_t dropped;
+    /// Time spent in "log", extrapolated from the timed calls
+    std::uint64_t log_time_ns;
+    /// Bucket n counts the timed "log" calls that took [2^n, 2^(n+1)) ns, bucket 0 also the faster ones
+    std::uint64_t log_time_histogram[buckets];
+};
+
+/**
+ * @brief
+ * Abstract log sink
+ *
+ * All log sinks must inherit from this Sink
+ */
+struct Sink
+{
+    Sink(const Filter& filter) : filter(filter)
+    {
+    }
+
+    virtual ~Sink() = default;
+
+    virtual void log(const Metadata& metadata, const std::string& message) = 0;
+
+    /// Every log line is passed to this entry point. The default calls "log" with the line's Metadata and message.
+    /// Sinks that can work with the RecordView (e.g. that copy its texts to a device) override it to not copy the line,
+    /// but still call "log" if a subclass might have overridden it, see "own_log".
+    virtual void log_record(const RecordView& record)
+    {
+        log(record.metadata(), record.message());
+    }
+
+    /// Several lines at once, e.g. from SinkAsync or a failed Scope, in order. The default calls "log_record" for each.
+    /// Sinks override it to amortize system calls, locks or setup over the batch.
+    virtual void log_batch(const RecordView* records, size_t count)
+    {
+        for (size_t n = 0; n < count; ++n)
+            log_record(records[n]);
+    }
+
+    /// A LOGB line. The default formats the message and calls "log_record", SinkBinary stores it as it is.
+    virtual void log_binary(const BinaryRecord& record);
+
+    /// Write out everything that is buffered or queued. Called on Log destruction.
+    virtual void flush()
+    {
+    }
+
+    /// @return true if "log" and "log_binary" may be called by several threads at once. Otherwise Log serializes
+    /// the calls with a lock per sink, so that threads only wait for each other if they log to the same sink.
+    virtual bool thread_safe() const
+    {
+        return false;
+    }
+
+    virtual SinkMetrics metrics() const
+    {
+        SinkMetrics result;
+        result.filtered = counters_.filtered.load(std::memory_order_relaxed);
+        result.written = counters_.written.load(std::memory_order_relaxed);
+        result.offered = result.filtered + result.written;
+        result.bytes = counters_.bytes.load(std::memory_order_relaxed);
+        result.log_time_ns = counters_.log_time_ns.load(std::memory_order_relaxed);
+        for (size_t bucket = 0; bucket < SinkMetrics::buckets; ++bucket)
+            result.log_time_histogram[bucket] = counters_.log_time_histogram[bucket].load(std::memory_order_relaxed);
+        return result;
+    }
+
+    Filter filter;
+
+protected:
+    /// @return true if "log" is the one of the sink's own class, i.e. if the sink is not an instance of a subclass that might override it.
+    /// Sinks that override "log_record" or "log_batch" to not copy the lines pass them on to "log" if it's false. They (and their
+    /// subclasses that don't override "log") override it with "return typeid(*this) == typeid(<sink class>);".
+    virtual bool own_log() const
+    {
+        return false;
+    }
+
+private:
+    friend class Log;
+
+    /// Maintained by Log while it dispatches to the sink, possibly from several threads at once.
+    /// A copied sink starts from zero.
+    struct Counters
+    {
+        Counters() : filtered(0), written(0), bytes(0), log_time_ns(0)
+        {
+            for (auto& bucket : log_time_histogram)
+                bucket.store(0, std::memory_order_relaxed);
+        }
+
+        Counters(const Counters& /*other*/) : Counters()
+        {
+        }
+
+        Counters& operator=(const Counters& /*other*/)
+        {
+            return *this;
+        }
+
+        static void add(std::atomic<std::uint64_t>& counter, std::uint64_t value)
+        {
+            counter.fetch_add(value, std::memory_order_relaxed);
+        }
+
+        /// "offered" is "filtered" + "written"
+        void rejected()
+        {
+            add(filtered, 1);
+        }
+
+        void logged(size_t size)
+        {
+            add(written, 1);
+            add(bytes, size);
+        }
+
+        void timed(const std::chrono::steady_clock::duration& duration)
+        {
+            auto ns = static_cast<std::uint64_t>(std::max<std::int64_t>(0, std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()));
+            size_t bucket = 0;
+            while ((bucket + 1 < SinkMetrics::buckets) && ((ns >> (bucket + 1)) != 0))
+                ++bucket;
+            add(log_time_ns, ns * SinkMetrics::timing_sample);
+            add(log_time_histogram[bucket], 1);
+        }
+
+        std::atomic<std::uint64_t> filtered;
+        std::atomic<std::uint64_t> written;
+        std::atomic<std::uint64_t> bytes;
+        std::atomic<std::uint64_t> log_time_ns;
+        std::atomic<std::uint64_t> log_time_histogram[SinkMetrics::buckets];
+    };
+
+    /// A copied sink gets its own mutex
+    struct DispatchMutex : public std::recursive_mutex
+    {
+        DispatchMutex() = default;
+
+        DispatchMutex(const DispatchMutex& /*other*/) : std::recursive_mutex()
+        {
+        }
+
+        DispatchMutex& operator=(const DispatchMutex& /*other*/)
+        {
+            return *this;
+        }
+    };
+
+    Counters counters_;
+    /// Serializes Log's calls of a sink that is not "thread_safe"
+    DispatchMutex dispatch_mutex_;
+};
+
+/// ostream operators << for the meta data structs
+static std::ostream& operator<<(std::ostream& os, const Severity& log_severity);
+static std::ostream& operator<<(std::ostream& os, const Timestamp& timestamp);
+static std::ostream& operator<<(std::ostream& os, const Tag& tag);
+static std::ostream& operator<<(std::ostream& os, const Function& function);
+static std::ostream& operator<<(std::ostream& os, const SourceLocation& location);
+static std::ostream& operator<<(std::ostream& os, const Conditional& conditional);
+static std::ostream& operator<<(std::ostream& os, const Field& field);
+static std::ostream& operator<<(std::ostream& os, Limiter& limiter);
+static std::ostream& operator<<(std::ostream& os, const Color& color);
+static std::ostream& operator<<(std::ostream& os, const TextColor& text_color);
+
+using log_sink_ptr = std::shared_ptr<Sink>;
+
+/**
+ * @brief
+ * Runtime metrics of Log and its sinks, see Log::metrics
+ */
+struct LogMetrics
+{
+    LogMetrics() : lines(0), lock_waits(0), lock_wait_ns(0)
+    {
+    }
+
+    /// Lines that were dispatched to the sinks
+    std::uint64_t lines;
+    /// How often a thread found the logger or a sink locked by another thread
+    std::uint64_t lock_waits;
+    /// Time that threads spent waiting for the logger's and the sinks' locks
+    std::uint64_t lock_wait_ns;
+    /// Metrics of every sink, in the order of Log's sinks
+    std::vector<std::pair<log_sink_ptr, SinkMetrics>> sinks;
+};
+
+struct CallSite;
+/// Called by CallSite on registration and on changes, so that Log can compute its "enabled" mask
+static void on_call_site_changed(CallSite& call_site);
+
+/**
+ * @brief
+ * Static descriptor of a LOG statement
+ *
+ * Every LOG statement registers one of these on its first execution, in a global list that can be
+ * walked with "first" and "next". It has an atomic mask with one bit per severity, telling if any sink
+ * would accept the log line. The mask is recomputed when sinks or filters change, so that a disabled
+ * LOG statement costs a single relaxed load.
+ * The tag is only known for statements with a string literal tag, e.g. LOG(INFO, "net"), otherwise it's nullptr.
+ * For statements with a variable severity, "severity" is the one of the first execution.
+ */
+struct CallSite
+{
+    CallSite(const char* file, size_t line, const char* function, Severity severity, const char* tag)
+        : CallSite(file, line, function, severity, (tag != nullptr) ? Tag::intern(tag) : Tag::Interned{tag_id_empty, nullptr})
+    {
+    }
+
+    CallSite(const char* file, size_t line, const char* function, Severity severity, const Tag::Interned& tag)
+        : file(file), line(line), function(function), severity(severity), tag(tag.text), id(next_id()++), tag_id(tag.id), next_(first()), enabled_(0xff),
+          silenced_(false)
+    {
+        while (!head().compare_exchange_weak(next_, this))
+        {
+        }
+        on_call_site_changed(*this);
+    }
+
+    CallSite(const CallSite&) = delete;
+    CallSite& operator=(const CallSite&) = delete;
+
+    bool enabled(Severity severity) const
+    {
+        auto bit = static_cast<unsigned>(static_cast<int>(severity));
+        return (bit >= 8) || (((enabled_.load(std::memory_order_relaxed) >> bit) & 1u) != 0);
+    }
+
+    /// Switch the LOG statement off at runtime, or on again, i.e. let the sinks' filters decide
+    void set_enabled(bool enabled)
+    {
+        silenced_ = !enabled;
+        on_call_site_changed(*this);
+    }
+
+    /// Recompute the "enabled" mask
+    void update(const std::vector<log_sink_ptr>& log_sinks)
+    {
+        std::uint8_t mask = 0;
+        for (int bit = 0; (bit < 8) && !silenced_; ++bit)
+        {
+            auto severity = static_cast<Severity>(bit);
+            for (const auto& sink : log_sinks)
+            {
+                if ((tag != nullptr) ? sink->filter.match(tag_id, severity) : (bit >= sink->filter.min_severity()))
+                {
+                    mask |= static_cast<std::uint8_t>(1u << bit);
+                    break;
+                }
+            }
+        }
+        enabled_.store(mask, std::memory_order_relaxed);
+    }
+
+    /// @return the most recently registered call site
+    static CallSite* first()
+    {
+        return head().load(std::memory_order_acquire);
+    }
+
+    CallSite* next() const
+    {
+        return next_;
+    }
+
+    /// True for the type of a string literal (an array of const char), the only tags that are part of a call site
+    template <typename T>
+    struct is_static_tag : std::integral_constant<bool, std::is_array<typename std::remove_reference<T>::type>::value &&
+                                                            std::is_const<typename std::remove_extent<typename std::remove_reference<T>::type>::type>::value>
+    {
+    };
+
+    /// The tag of LOG(SEVERITY, TAG) is only part of the call site if it's a string literal.
+    /// Its text is interned on the first execution, i.e. the call site doesn't point to the caller's array.
+    template <size_t N>
+    static const char* static_tag(const char (&tag)[N])
+    {
+        return tag;
+    }
+
+    /// A char buffer might hold another tag on every execution
+    template <size_t N>
+    static const char* static_tag(char (&/*tag*/)[N])
+    {
+        return nullptr;
+    }
+
+    template <typename T>
+    static const char* static_tag(const T& /*tag*/)
+    {
+        return nullptr;
+    }
+
+    const char* file;
+    size_t line;
+    const char* function;
+    Severity severity;
+    /// The interned text of a string literal tag, see "static_tag", or nullptr
+    const char* tag;
+    /// Small number that identifies the call site within the process, in order of registration
+    std::uint32_t id;
+    /// Id of "tag", see Tag::id
+    size_t tag_id;
+
+private:
+    static std::atomic<CallSite*>& head()
+    {
+        static std::atomic<CallSite*> call_site(nullptr);
+        return call_site;
+    }
+
+    static std::atomic<std::uint32_t>& next_id()
+    {
+        static std::atomic<std::uint32_t> id(0);
+        return id;
+    }
+
+    CallSite* next_;
+    std::atomic<std::uint8_t> enabled_;
+    std::atomic<bool> silenced_;
+};
+
+/**
+ * @brief
+ * "{}" formatting for LOGF (and LOGB), without iostreams
+ *
+ * Every "{}" in the format is replaced by the next argument, "{{" and "}}" are literal braces.
+ * Arguments are rendered like "operator<<" would with default flags: integers and floating point
+ * numbers (6 significant digits) are converted directly, other types fall back to "operator<<".
+ */
+struct Format
+{
+    /// @return number of "{}" in "format", or -1 if it has a brace that is neither part of "{}" nor escaped
+    template <size_t N>
+    static constexpr int placeholders(const char (&format)[N])
+    {
+        return finish(scan(format, 0, N, 0));
+    }
+
+    /// Scan the characters [begin, end) of a format, starting in "state": 0 text, 1 after '{', 2 after '}', 3 after the '\0'.
+    /// @return number of "{}" * 4 + state at the end, or -1 for a stray brace.
+    /// The range is split in halves, i.e. the recursion depth of the constant evaluation is logarithmic in the format's length.
+    static constexpr int scan(const char* format, size_t begin, size_t end, int state)
+    {
+        return (end - begin == 1) ? step(format[begin], state)
+                                  : scan_rest(scan(format, begin, begin + (end - begin) / 2, state), format, begin + (end - begin) / 2, end);
+    }
+
+    static constexpr int scan_rest(int left, const char* format, size_t begin, size_t end)
+    {
+        return (left < 0) ? -1 : add(left - left % 4, scan(format, begin, end, left % 4));
+    }
+
+    static constexpr int add(int count, int right)
+    {
+        return (right < 0) ? -1 : count + right;
+    }
+
+    static constexpr int step(char c, int state)
+    {
+        return (state == 3)   ? 3
+               : (state == 1) ? ((c == '{') ? 0 : ((c == '}') ? 4 : -1))
+               : (state == 2) ? ((c == '}') ? 0 : -1)
+               : (c == '{')   ? 1
+               : (c == '}')   ? 2
+               : (c == '\0')  ? 3
+                              : 0;
+    }
+
+    static constexpr int finish(int result)
+    {
+        return ((result < 0) || (result % 4 == 1) || (result % 4 == 2)) ? -1 : result / 4;
+    }
+
+    /// Number of arguments that are formatted, i.e. that are not a Field
+    template <typename... Args>
+    struct Count;
+
+    /// Only the type is used, in "decltype", to count the arguments at compile time
+    template <typename... Args>
+    static Count<Args...> count(const Args&... args);
+
+    static void format_to(std::string& message, const char* format)
+    {
+        while (*(format = literal(message, format)) != '\0')
+        {
+            message.append("{}");
+            format += 2;
+        }
+    }
+
+    /// Fields are not formatted, but added to the line's metadata
+    template <typename... Args>
+    static void format_to(std::string& message, const char* format, const Field& /*field*/, const Args&... args)
+    {
+        format_to(message, format, args...);
+    }
+
+    template <typename T, typename... Args>
+    static void format_to(std::string& message, const char* format, const T& arg, const Args&... args)
+    {
+        format = literal(message, format);
+        if (*format == '\0')
+            return;
+        append(message, arg);
+        format_to(message, format + 2, args...);
+    }
+
+    /// Append the text of "format" up to the next "{}", with "{{" and "}}" unescaped
+    /// @return position of the "{}", or of the terminating '\0'
+    static const char* literal(std::string& message, const char* format)
+    {
+        for (;;)
+        {
+            const char* brace = format;
+            while ((*brace != '\0') && (*brace != '{') && (*brace != '}'))
+                ++brace;
+            message.append(format, brace);
+            if (*brace == '\0')
+                return brace;
+            if ((*brace == '{') && (*(brace + 1) == '}'))
+                return brace;
+            message.push_back(*brace);
+            // an escaped brace, or a stray one that is taken literally
+            format = brace + ((*(brace + 1) == *brace) ? 2 : 1);
+        }
+    }
+
+    static void append(std::string& message, bool value)
+    {
+        message.push_back(value ? '1' : '0');
+    }
+
+    static void append(std::string& message, char value)
+    {
+        message.push_back(value);
+    }
+
+    static void append(std::string& message, signed char value)
+    {
+        message.push_back(static_cast<char>(value));
+    }
+
+    static void append(std::string& message, unsigned char value)
+    {
+        message.push_back(static_cast<char>(value));
+    }
+
+    template <typename T>
+    static typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type append(std::string& message, T value)
+    {
+        auto magnitude = static_cast<unsigned long long>(value);
+        append_integer(message, (value < 0) ? 0ull - magnitude : magnitude, value < 0);
+    }
+
+    template <typename T>
+    static typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type append(std::string& message, T value)
+    {
+        append_integer(message, value, false);
+    }
+
+    template <typename T>
+    static typename std::enable_if<std::is_floating_point<T>::value>::type append(std::string& message, T value)
+    {
+        char buffer[32];
+#if defined(__cpp_lib_to_chars) && (__cpp_lib_to_chars >= 201611L)
+        message.append(buffer, std::to_chars(buffer, buffer + sizeof(buffer), static_cast<double>(value), std::chars_format::general, 6).ptr);
+#else
+        message.append(buffer, static_cast<size_t>(std::snprintf(buffer, sizeof(buffer), "%g", static_cast<double>(value))));
+#endif
+    }
+
+    static void append(std::string& message, const char* value)
+    {
+        message.append((value != nullptr) ? value : "(null)");
+    }
+
+    static void append(std::string& message, const std::string& value)
+    {
+        message.append(value);
+    }
+
+    template <typename T>
+    static void append(std::string& message, const T* value)
+    {
+        append_pointer(message, reinterpret_cast<std::uintptr_t>(value));
+    }
+
+    template <typename T>
+    static typename std::enable_if<!std::is_arithmetic<T>::value && !std::is_pointer<T>::value && !std::is_array<T>::value>::type append(std::string& message,
+                                                                                                                                        const T& value)
+    {
+        std::ostringstream stream;
+        stream << value;
+        message.append(stream.str());
+    }
+
+    static void append_integer(std::string& message, unsigned long long value, bool negative)
+    {
+        static const char digits[] = "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+                                     "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+                                     "8081828384858687888990919293949596979899";
+        char buffer[24];
+        char* end = buffer + sizeof(buffer);
+        char* pos = end;
+        while (value >= 100)
+        {
+            auto two = static_cast<size_t>(value % 100) * 2;
+            value /= 100;
+            *--pos = digits[two + 1];
+            *--pos = digits[two];
+        }
+        if (value >= 10)
+        {
+            auto two = static_cast<size_t>(value) * 2;
+            *--pos = digits[two + 1];
+            *--pos = digits[two];
+        }
+        else
+        {
+            *--pos = static_cast<char>('0' + value);
+        }
+        if (negative)
+            *--pos = '-';
+        message.append(pos, end);
+    }
+
+    static void append_pointer(std::string& message, unsigned long long value)
+    {
+        char buffer[20];
+        char* end = buffer + sizeof(buffer);
+        char* pos = end;
+        do
+        {
+            *--pos = "0123456789abcdef"[value & 0xf];
+            value >>= 4;
+        } while (value != 0);
+        *--pos = 'x';
+        *--pos = '0';
+        message.append(pos, end);
+    }
+};
+
+template <>
+struct Format::Count<> : std::integral_constant<int, 0>
+{
+};
+
+template <typename T, typename... Args>
+struct Format::Count<T, Args...> : std::integral_constant<int, (std::is_same<T, Field>::value ? 0 : 1) + Format::Count<Args...>::value>
+{
+};
+
+inline void Field::append_value(std::string& text) const
+{
+    switch (type)
+    {
+        case Type::boolean:
+            text.append(value.boolean ? "true" : "false");
+            break;
+        case Type::integer:
+            Format::append(text, value.integer);
+            break;
+        case Type::unsigned_integer:
+            Format::append(text, value.unsigned_integer);
+            break;
+        case Type::floating_point:
+            Format::append(text, value.floating_point);
+            break;
+        case Type::literal:
+            text.append(value.literal);
+            break;
+        case Type::string:
+            text.append(string);
+            break;
+    }
+}
+
+/**
+ * @brief
+ * Collapses consecutive duplicate log lines
+ *
+ * A line with the same severity, tag and message as the previous one is suppressed if it is logged within
+ * "window" of the run's first line, only the repetitions are counted. The run ends with the next different line,
+ * with the first repetition after the window (which is logged and starts a new run) or on "flush". Then a summary
+ * "last message repeated N times" is emitted, with the fields "repeated", "first" and "last" (time of the first
+ * and last repetition). A repetition costs a comparison with the previous message, a new line copies its message.
+ * Not thread safe, Log and SinkDedup call it with their lock held.
+ */
+struct Dedup
+{
+    Dedup(std::chrono::milliseconds window = std::chrono::seconds(30))
+        : window_(window), severity_(Severity::trace), tag_id_(tag_id_empty), valid_(false), repeated_(0)
+    {
+    }
+
+    /// @param summary called with the summary (metadata, message) of a run that ends with this line
+    /// @return false if the line is a suppressed repetition
+    template <typename Summary>
+    bool pass(const Metadata& metadata, const std::string& message, const Summary& summary)
+    {
+        auto now = metadata.timestamp ? metadata.timestamp.time_point : std::chrono::system_clock::now();
+        // tags that are not interned share an id
+        bool repeat = valid_ && (metadata.severity == severity_) && (metadata.tag.id == tag_id_) &&
+                      ((tag_id_ != tag_id_unknown) || (metadata.tag.text == tag_)) && (message == message_);
+        if (repeat && (now - run_start_ < window_))
+        {
+            if (repeated_++ == 0)
+            {
+                summary_ = metadata;
+                // replaced by the summary's fields, don't keep pointers into the LOG statement
+                summary_.fields.clear();
+                first_ = now;
+            }
+            last_ = now;
+            return false;
+        }
+
+        flush(summary);
+        if (!repeat)
+        {
+            valid_ = true;
+            severity_ = metadata.severity;
+            tag_id_ = metadata.tag.id;
+            if (tag_id_ == tag_id_unknown)
+                tag_.assign(metadata.tag.text);
+            message_.assign(message);
+        }
+        run_start_ = now;
+        return true;
+    }
+
+    /// Emit the summary of the pending run, if any
+    template <typename Summary>
+    void flush(const Summary& summary)
+    {
+        if (repeated_ == 0)
+            return;
+        std::string message("last message repeated ");
+        Format::append(message, repeated_);
+        message.append((repeated_ == 1) ? " time" : " times");
+        summary_.timestamp = Timestamp(last_);
+        summary_.fields.clear();
+        summary_.fields.emplace_back("repeated", repeated_);
+        summary_.fields.emplace_back("first", Timestamp(first_).to_string("%Y-%m-%dT%H:%M:%S.#ms"));
+        summary_.fields.emplace_back("last", Timestamp(last_).to_string("%Y-%m-%dT%H:%M:%S.#ms"));
+        repeated_ = 0;
+        summary(static_cast<const Metadata&>(summary_), static_cast<const std::string&>(message));
+    }
+
+    /// Forget the previous line, e.g. when the sinks change. Call "flush" before.
+    void reset()
+    {
+        valid_ = false;
+        repeated_ = 0;
+    }
+
+private:
+    std::chrono::milliseconds window_;
+    /// the previous line
+    Severity severity_;
+    size_t tag_id_;
+    /// the text of a tag that is not interned
+    std::string tag_;
+    std::string message_;
+    bool valid_;
+    /// the current run
+    std::chrono::system_clock::time_point run_start_;
+    std::uint64_t repeated_;
+    std::chrono::system_clock::time_point first_;
+    std::chrono::system_clock::time_point last_;
+    Metadata summary_;
+};
+
+/**
+ * @brief
+ * Binary encoding of a LOGB argument
+ *
+ * "type" is the one character type code that is stored with the call site, "encode" appends the
+ * value in native byte order: 'b' bool, 'c' char, 'i'/'I' (unsigned) 32 bit, 'l'/'L' (unsigned) 64 bit integer,
+ * 'd' double, 'p' pointer (64 bit) and 's' string (32 bit length + characters).
+ */
+template <typename T, typename Enable = void>
+struct BinaryArg
+{
+    static_assert(sizeof(T) == 0, "LOGB: unsupported argument type, use integers, floating point numbers, strings or pointers");
+};
+
+template <typename T>
+static void binary_put(std::string& data, const T& value)
+{
+    data.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <>
+struct BinaryArg<bool>
+{
+    static const char type = 'b';
+    static void encode(std::string& data, bool value)
+    {
+        data.push_back(value ? 1 : 0);
+    }
+};
+
+template <typename T>
+struct is_char : std::integral_constant<bool, std::is_same<T, char>::value || std::is_same<T, signed char>::value || std::is_same<T, unsigned char>::value>
+{
+};
+
+template <typename T>
+struct BinaryArg<T, typename std::enable_if<is_char<T>::value>::type>
+{
+    static const char type = 'c';
+    static void encode(std::string& data, T value)
+    {
+        data.push_back(static_cast<char>(value));
+    }
+};
+
+template <typename T>
+struct BinaryArg<T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value && !is_char<T>::value>::type>
+{
+    static const bool wide = (sizeof(T) > 4);
+    static const char type = std::is_signed<T>::value ? (wide ? 'l' : 'i') : (wide ? 'L' : 'I');
+    static void encode(std::string& data, T value)
+    {
+        using stored =
+            typename std::conditional<std::is_signed<T>::value, typename std::conditional<wide, std::int64_t, std::int32_t>::type,
+                                      typename std::conditional<wide, std::uint64_t, std::uint32_t>::type>::type;
+        binary_put(data, static_cast<stored>(value));
+    }
+};
+
+template <typename T>
+struct BinaryArg<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
+{
+    static const char type = 'd';
+    static void encode(std::string& data, T value)
+    {
+        binary_put(data, static_cast<double>(value));
+    }
+};
+
+template <typename T>
+struct BinaryArg<T, typename std::enable_if<std::is_same<T, const char*>::value || std::is_same<T, char*>::value || std::is_same<T, std::string>::value>::type>
+{
+    static const char type = 's';
+    static void encode(std::string& data, const std::string& value)
+    {
+        binary_put(data, static_cast<std::uint32_t>(value.size()));
+        data.append(value);
+    }
+    static void encode(std::string& data, const char* value)
+    {
+        if (value == nullptr)
+            value = "(null)";
+        auto size = std::strlen(value);
+        binary_put(data, static_cast<std::uint32_t>(size));
+        data.append(value, size);
+    }
+};
+
+template <typename T>
+struct BinaryArg<T*, typename std::enable_if<!std::is_same<typename std::remove_cv<T>::type, char>::value>::type>
+{
+    static const char type = 'p';
+    static void encode(std::string& data, const T* value)
+    {
+        binary_put(data, static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(value)));
+    }
+};
+
+/**
+ * @brief
+ * A LOGB line: the call site, severity, timestamp and the binary encoded arguments (see BinaryArg)
+ *
+ * The text is only rendered if a sink asks for "metadata" or "message", and then only once for all sinks.
+ */
+struct BinaryRecord
+{
+    BinaryRecord(const CallSite& call_site, Severity severity, const std::chrono::system_clock::time_point& timestamp, const char* format, const char* types,
+                 const std::string& data)
+        : call_site(call_site), severity(severity), timestamp(timestamp), format(format), types(types), data(data), rendered_(false)
+    {
+    }
+
+    const Metadata& metadata() const
+    {
+        render();
+        return metadata_;
+    }
+
+    const std::string& message() const
+    {
+        render();
+        return message_;
+    }
+
+    /// Replace every "{}" in "format" with the next argument from "data", "{{" and "}}" are the braces
+    /// @return false if "data" is shorter than "types" say
+    static bool format_message(std::string& message, const char* format, const char* types, const char* data, size_t size)
+    {
+        const char* end = data + size;
+        bool ok = true;
+        while (*(format = Format::literal(message, format)) != '\0')
+        {
+            if (*types != '\0')
+                ok = ok && format_arg(message, *types++, data, end);
+            else
+                message.append("{}");
+            format += 2;
+        }
+        return ok;
+    }
+
+    const CallSite& call_site;
+    Severity severity;
+    std::chrono::system_clock::time_point timestamp;
+    const char* format;
+    const char* types;
+    const std::string& data;
+
+private:
+    template <typename T>
+    static bool get(const char*& data, const char* end, T& value)
+    {
+        if (static_cast<size_t>(end - data) < sizeof(T))
+            return false;
+        std::memcpy(&value, data, sizeof(T));
+        data += sizeof(T);
+        return true;
+    }
+
+    static bool format_arg(std::string& message, char type, const char*& data, const char* end)
+    {
+        union
+        {
+            std::int32_t i;
+            std::uint32_t u;
+            std::int64_t l;
+            std::uint64_t ul;
+            double d;
+            char c;
+        } value;
+        switch (type)
+        {
+            case 'b':
+                if (!get(data, end, value.c))
+                    return false;
+                Format::append(message, value.c != 0);
+                return true;
+            case 'c':
+                if (!get(data, end, value.c))
+                    return false;
+                message.push_back(value.c);
+                return true;
+            case 'i':
+                if (!get(data, end, value.i))
+                    return false;
+                Format::append(message, value.i);
+                return true;
+            case 'I':
+                if (!get(data, end, value.u))
+                    return false;
+                Format::append(message, value.u);
+                return true;
+            case 'l':
+                if (!get(data, end, value.l))
+                    return false;
+                Format::append(message, value.l);
+                return true;
+            case 'L':
+                if (!get(data, end, value.ul))
+                    return false;
+                Format::append(message, value.ul);
+                return true;
+            case 'd':
+                if (!get(data, end, value.d))
+                    return false;
+                Format::append(message, value.d);
+                return true;
+            case 'p':
+                if (!get(data, end, value.ul))
+                    return false;
+                Format::append_pointer(message, value.ul);
+                return true;
+            case 's':
+                if (!get(data, end, value.u) || (static_cast<size_t>(end - data) < value.u))
+                    return false;
+                message.append(data, value.u);
+                data += value.u;
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    void render() const
+    {
+        if (rendered_)
+            return;
+        rendered_ = true;
+        metadata_.severity = severity;
+        metadata_.tag = (call_site.tag != nullptr) ? Tag(call_site.tag) : Tag(nullptr);
+        metadata_.function = Function(call_site.function, call_site.file, call_site.line);
+        metadata_.timestamp = Timestamp(timestamp);
+        format_message(message_, format, types, data.data(), data.size());
+    }
+
+    mutable bool rendered_;
+    mutable Metadata metadata_;
+    mutable std::string message_;
+};
+
+/**
+ * @brief
+ * Epoch based reclamation of objects that are read without locks (RCU style), e.g. Log's snapshot of the sinks
+ *
+ * A reader marks its thread as reading with an Epoch::Reader, which costs two stores into a per thread slot.
+ * A writer publishes a new version with an atomic exchange and hands the old one to "retire". It is deleted once
+ * every thread that might still read it has left its read section, checked whenever something is retired,
+ * or by "drain", which waits for the readers.
+ * Pointers to published objects must be loaded within a read section with (at least) memory_order_seq_cst.
+ */
+class Epoch
+{
+    struct Slot;
+
+public:
+    /// Marks the calling thread as reading, for as long as it exists. Can be nested.
+    class Reader
+    {
+    public:
+        Reader() : slot_(Epoch::slot())
+        {
+            if (slot_.depth++ == 0)
+                slot_.epoch.store(current().load(std::memory_order_relaxed), std::memory_order_seq_cst);
+        }
+
+        ~Reader()
+        {
+            if (--slot_.depth == 0)
+                slot_.epoch.store(0, std::memory_order_release);
+        }
+
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+    private:
+        Slot& slot_;
+    };
+
+    /// Delete "object" once no thread reads it anymore. Call it after "object" was replaced.
+    template <typename T>
+    static void retire(const T* object)
+    {
+        if (object == nullptr)
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mutex());
+            std::uint64_t epoch = current().fetch_add(1, std::memory_order_seq_cst) + 1;
+            retired().push_back(Retired{epoch, [object] { delete object; }});
+        }
+        reclaim();
+    }
+
+    /// Wait until the threads that might read what is retired so far have left their read section, and delete it.
+    /// Must not be called with a lock held that readers take. If the calling thread is reading itself, it doesn't wait.
+    static void drain()
+    {
+        Slot& own = slot();
+        if (own.depth == 0)
+        {
+            std::uint64_t epoch = current().load(std::memory_order_seq_cst);
+            for (Slot* slot = slots().load(std::memory_order_acquire); slot != nullptr; slot = slot->next)
+            {
+                std::uint64_t reading;
+                while (((reading = slot->epoch.load(std::memory_order_seq_cst)) != 0) && (reading < epoch))
+                    std::this_thread::yield();
+            }
+        }
+        reclaim();
+    }
+
+private:
+    struct Slot
+    {
+        Slot() : epoch(0), used(true), depth(0), next(nullptr)
+        {
+        }
+
+        /// epoch in which the thread started reading, 0 if it isn't
+        std::atomic<std::uint64_t> epoch;
+        std::atomic<bool> used;
+        size_t depth;
+        Slot* next;
+    };
+
+    struct Retired
+    {
+        std::uint64_t epoch;
+        std::function<void()> destroy;
+    };
+
+    /// Delete the retired objects that no thread reads anymore. They are deleted without the lock, their d'tors might retire.
+    static void reclaim()
+    {
+        std::vector<Retired> reclaimed;
+        {
+            std::lock_guard<std::mutex> lock(mutex());
+            std::uint64_t oldest = std::numeric_limits<std::uint64_t>::max();
+            for (Slot* slot = slots().load(std::memory_order_acquire); slot != nullptr; slot = slot->next)
+            {
+                std::uint64_t reading = slot->epoch.load(std::memory_order_seq_cst);
+                if (reading != 0)
+                    oldest = std::min(oldest, reading);
+            }
+            auto& list = retired();
+            auto end = std::partition(list.begin(), list.end(), [oldest](const Retired& retired) { return retired.epoch > oldest; });
+            std::move(end, list.end(), std::back_inserter(reclaimed));
+            list.erase(end, list.end());
+        }
+        for (auto& retired : reclaimed)
+            retired.destroy();
+    }
+
+    /// The calling thread's slot, released for other threads on thread exit
+    static Slot& slot()
+    {
+        struct Owner
+        {
+            Owner(Slot*& current, bool& destroyed) : current_(current), destroyed_(destroyed)
+            {
+                current_ = acquire();
+            }
+
+            ~Owner()
+            {
+                current_->epoch.store(0, std::memory_order_relaxed);
+                current_->used.store(false, std::memory_order_release);
+                current_ = nullptr;
+                destroyed_ = true;
+            }
+
+            Slot*& current_;
+            bool& destroyed_;
+        };
+
+        // trivially destructible, see Log::record
+        static thread_local Slot* current = nullptr;
+        static thread_local bool destroyed = false;
+        if (current == nullptr)
+        {
+            if (destroyed)
+                current = acquire(); // reading from a d'tor after the Owner is gone, the slot is never released
+            else
+                static thread_local Owner owner(current, destroyed);
+        }
+        return *current;
+    }
+
+    /// Reuse the slot of an ended thread, or add a new one. Slots are never deleted.
+    static Slot* acquire()
+    {
+        for (Slot* slot = slots().load(std::memory_order_acquire); slot != nullptr; slot = slot->next)
+        {
+            bool used = false;
+            if (!slot->used.load(std::memory_order_relaxed) && slot->used.compare_exchange_strong(used, true, std::memory_order_acquire))
+            {
+                slot->depth = 0;
+                return slot;
+            }
+        }
+        Slot* slot = new Slot();
+        slot->next = slots().load(std::memory_order_relaxed);
+        while (!slots().compare_exchange_weak(slot->next, slot, std::memory_order_release, std::memory_order_relaxed))
+        {
+        }
+        return slot;
+    }
+
+    static std::atomic<Slot*>& slots()
+    {
+        static std::atomic<Slot*> head(nullptr);
+        return head;
+    }
+
+    static std::atomic<std::uint64_t>& current()
+    {
+        static std::atomic<std::uint64_t> epoch(1);
+        return epoch;
+    }
+
+    // never destroyed, objects are retired and drained up to the very end, e.g. by Log's d'tor
+    static std::mutex& mutex()
+    {
+        static std::mutex& mutex = *new std::mutex();
+        return mutex;
+    }
+
+    static std::vector<Retired>& retired()
+    {
+        static std::vector<Retired>& retired = *new std::vector<Retired>();
+        return retired;
+    }
+};
+
+/**
+ * @brief
+ * Holds back the log lines of the current thread, and passes them to the sinks only if something went wrong
+ *
+ * While a Scope exists, the lines that the thread logs are collected. If one of them has the "trigger"
+ * severity or higher, or if "fail" is called, the collected lines are passed on and the following ones go
+ * through directly. Otherwise they are discarded when the Scope ends. Scopes can be nested, the lines
+ * of an inner scope are passed on to the outer one. Only lines that some sink would accept are collected,
+ * i.e. the sinks must accept e.g. debug lines to get them for failing scopes.
+ * At most "max_lines" lines are held back, further ones are dropped.
+ *
+ * e.g.:
+ * void handle(const Request& request)
+ * {
+ *     AixLog::Scope scope(AixLog::Severity::error);
+ *     LOG(DEBUG) << "parsing " << request.id << "\n"; // only logged if the request fails with an error
+ *     ...
+ * }
+ */
+class Scope
+{
+public:
+    Scope(Severity trigger = Severity::error, size_t max_lines = 10000);
+    ~Scope();
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+    /// Pass on the collected lines now, and the following ones directly
+    void fail();
+
+    /// @return true if the lines are passed on
+    bool failed() const
+    {
+        return failed_;
+    }
+
+    /// @return number of lines that were dropped because of "max_lines"
+    size_t dropped() const
+    {
+        return dropped_;
+    }
+
+private:
+    friend class Log;
+
+    /// @return true if the line is held back, false if it is to be passed to the sinks
+    bool capture(const Metadata& metadata, const std::string& message)
+    {
+        if (!failed_ && (metadata.severity >= trigger_))
+            fail();
+        if (failed_)
+            return (outer_ != nullptr) && outer_->capture(metadata, message);
+        if (size_ == max_lines_)
+        {
+            ++dropped_;
+            return true;
+        }
+        // assignment reuses the capacity of the lines of earlier scopes
+        if (size_ == lines_.size())
+            lines_.emplace_back();
+        lines_[size_].metadata = metadata;
+        lines_[size_].metadata.own_fields();
+        lines_[size_].message = message;
+        ++size_;
+        return true;
+    }
+
+    Severity trigger_;
+    size_t max_lines_;
+    Scope* outer_;
+    std::vector<Record::Line> lines_;
+    size_t size_;
+    size_t dropped_;
+    bool failed_;
+};
+
+/**
+ * @brief
+ * Main Logger class with "Log::init"
+ *
+ * Don't use it directly, but call once "Log::init" with your log sink instances.
+ * The Log class will simply redirect clog to itself (as a streambuf) and
+ * forward whatever went to clog to the log sink instances
+ */
+class Log : public std::basic_streambuf<char, std::char_traits<char>>
+{
+public:
+    static Log& instance()
+    {
+        static Log instance_;
+        return instance_;
+    }
+
+    /// Without "init" every LOG(X) will simply go to clog
+    /// Replaced sinks are released once no thread logs to them anymore, before "init" returns.
+    static void init(const std::vector<log_sink_ptr> log_sinks = {})
+    {
+        Log& log = Log::instance();
+        {
+            std::lock_guard<std::recursive_mutex> lock(log.mutex_);
+            log.flush_dedup();
+            log.flush_limiters();
+            for (const auto& sink : log.log_sinks_)
+                registered(*sink, false);
+            for (const auto& sink : log_sinks)
+                registered(*sink, true);
+            log.log_sinks_ = log_sinks;
+            log.update_filters();
+        }
+        Epoch::drain();
+    }
+
+    template <typename T, typename... Ts>
+    static std::shared_ptr<T> init(Ts&&... params)
+    {
+        std::shared_ptr<T> sink = Log::instance().add_logsink<T>(std::forward<Ts>(params)...);
+        init({sink});
+        return sink;
+    }
+
+    template <typename T, typename... Ts>
+    std::shared_ptr<T> add_logsink(Ts&&... params)
+    {
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        static_assert(std::is_base_of<Sink, typename std::decay<T>::type>::value, "type T must be a Sink");
+        std::shared_ptr<T> sink = std::make_shared<T>(std::forward<Ts>(params)...);
+        registered(*sink, true);
+        log_sinks_.push_back(sink);
+        update_filters();
+        return sink;
+    }
+
+    void add_logsink(const log_sink_ptr& sink)
+    {
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        registered(*sink, true);
+        log_sinks_.push_back(sink);
+        update_filters();
+    }
+
+    /// The sink is released by Log once no thread logs to it anymore, before "remove_logsink" returns
+    void remove_logsink(const log_sink_ptr& sink)
+    {
+        {
+            std::lock_guard<std::recursive_mutex> lock(mutex_);
+            auto end = std::remove(log_sinks_.begin(), log_sinks_.end(), sink);
+            for (auto iter = end; iter != log_sinks_.end(); ++iter)
+                registered(**iter, false);
+            log_sinks_.erase(end, log_sinks_.end());
+            update_filters();
+        }
+        Epoch::drain();
+    }
+
+    /// Replace the severities of a sink's filter while other threads are logging, see Filter::set_levels
+    void set_filter(const log_sink_ptr& sink, const Filter& filter)
+    {
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        sink->filter.set_levels(filter);
+    }
+
+    /// Log the pending summaries of Dedup and of the limiters, e.g. the lines suppressed at the end of a burst, and flush the sinks.
+    /// Done at exit anyway, and "init" logs the pending summaries before it replaces the sinks.
+    void flush()
+    {
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        flush_dedup();
+        flush_limiters();
+        for (const auto& sink : log_sinks_)
+            sink->flush();
+    }
+
+    /// Collapse consecutive duplicate lines for all sinks, see Dedup. A window of 0 switches it off.
+    /// SinkDedup does the same for a single sink.
+    void set_dedup(std::chrono::milliseconds window)
+    {
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        flush_dedup();
+        dedup_.reset((window.count() > 0) ? new Dedup(window) : nullptr);
+        update_filters();
+    }
+
+    /// Recompute the "enabled" masks of all call sites from the sinks' filters and publish a new Snapshot for dispatching.
+    /// Called automatically when sinks are added or removed and when the Filter of one of the sinks is changed.
+    void update_filters()
+    {
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        auto snapshot = new Snapshot();
+        snapshot->sinks.reserve(log_sinks_.size());
+        for (const auto& sink : log_sinks_)
+            snapshot->sinks.push_back(Snapshot::Entry{sink, sink->filter.shared_copy()});
+        snapshot->dedup = (dedup_ != nullptr);
+        // threads that are dispatching keep the snapshot they started with, it's deleted once they are done
+        Epoch::retire(snapshot_.exchange(snapshot, std::memory_order_seq_cst));
+        for (CallSite* call_site = CallSite::first(); call_site != nullptr; call_site = call_site->next())
+            call_site->update(log_sinks_);
+    }
+
+    /// Lets sinks share the work of rendering the log line that is currently dispatched on this thread.
+    /// @param key identifies how the line is rendered, e.g. the format
+    /// @param hit set to true if the returned line was already rendered with the same "key" by another sink
+    /// @return the buffer to render the line into, or nullptr if the line isn't dispatched by Log
+    static std::string* shared_render(const Metadata& metadata, const std::string& message, const std::string& key, bool& hit)
+    {
+        return shared_render(RecordView(metadata, message), key, hit);
+    }
+
+    static std::string* shared_render(const RecordView& line, const std::string& key, bool& hit)
+    {
+        Record& rec = record();
+        hit = false;
+        if (rec.dispatch_id == 0)
+            return nullptr;
+
+        const Metadata* metadata = line.metadata_;
+        const char* message = line.message_.data();
+        for (auto& rendered : rec.rendered)
+        {
+            if ((rendered.dispatch_id == rec.dispatch_id) && (rendered.metadata == metadata) && (rendered.message == message) && (rendered.key == key))
+            {
+                hit = true;
+                return &rendered.line;
+            }
+        }
+
+        Record::Rendered& rendered = rec.rendered[rec.next_rendered];
+        rec.next_rendered = (rec.next_rendered + 1) % (sizeof(rec.rendered) / sizeof(rec.rendered[0]));
+        rendered.dispatch_id = rec.dispatch_id;
+        rendered.metadata = metadata;
+        rendered.message = message;
+        rendered.key = key;
+        return &rendered.line;
+    }
+
+    /// Call "function" for a line that a sink makes up while it handles the dispatched one, e.g. a summary.
+    /// The made up line gets its own dispatch id, so that it is not mistaken for another line in "shared_render".
+    template <typename Function>
+    static void own_line(const Function& function)
+    {
+        Record& rec = record();
+        std::uint64_t outer_dispatch_id = rec.dispatch_id;
+        if (outer_dispatch_id != 0)
+            rec.dispatch_id = ++rec.dispatch_count;
+        function();
+        rec.dispatch_id = outer_dispatch_id;
+    }
+
+    /// @return a snapshot of the logger's and its sinks' counters
+    LogMetrics metrics()
+    {
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        LogMetrics result;
+        result.lines = lines_.load(std::memory_order_relaxed);
+        result.lock_waits = lock_waits_.load(std::memory_order_relaxed);
+        result.lock_wait_ns = lock_wait_ns_.load(std::memory_order_relaxed);
+        for (const auto& sink : log_sinks_)
+            result.sinks.emplace_back(sink, sink->metrics());
+        return result;
+    }
+
+    /// @return the logger, or nullptr if it is not yet created
+    static Log* existing()
+    {
+        return existing_instance().load(std::memory_order_acquire);
+    }
+
+    /// Called by LOGF: the message is formatted directly into the thread's record, without iostreams,
+    /// and passed to the sinks like any other line
+    template <typename T, size_t N, typename... Args>
+    static void log_format(const CallSite& call_site, Severity severity, const T& tag, const char (&format)[N], const Args&... args)
+    {
+        Log* log = existing();
+        if (log == nullptr)
+            return;
+
+        Record& rec = record();
+        if (rec.formatting)
+        {
+            // logged while formatting or dispatching another LOGF line of this thread
+            Metadata metadata;
+            std::string message;
+            Log::format(metadata, message, call_site, severity, tag, format, args...);
+            log->dispatch(RecordView(metadata, message, SourceLocation(call_site.function, call_site.file, call_site.line)));
+            return;
+        }
+
+        rec.formatting = true;
+        Log::format(rec.format_metadata, rec.format_message, call_site, severity, tag, format, args...);
+        log->dispatch(RecordView(rec.format_metadata, rec.format_message, SourceLocation(call_site.function, call_site.file, call_site.line)));
+        rec.formatting = false;
+    }
+
+    /// Called by LOGB: the arguments are copied in binary form into the thread's buffer and handed to the
+    /// sinks as a BinaryRecord. Formatting is left to the sinks, SinkBinary doesn't format at all.
+    template <size_t N, typename... Args>
+    static void log_binary(const CallSite& call_site, Severity severity, const char (&format)[N], const Args&... args)
+    {
+        Log* log = existing();
+        if (log == nullptr)
+            return;
+
+        static const char types[] = {BinaryArg<typename std::decay<Args>::type>::type..., '\0'};
+        // swapped out, a sink might log itself
+        std::string data;
+        data.swap(record().binary);
+        data.clear();
+        using expand = int[];
+        (void)expand{0, (BinaryArg<typename std::decay<Args>::type>::encode(data, args), 0)...};
+
+        log->dispatch(BinaryRecord(call_site, severity, std::chrono::system_clock::now(), format, types, data));
+        data.swap(record().binary);
+    }
+
+protected:
+    Log() noexcept : snapshot_(new Snapshot()), lines_(0), lock_waits_(0), lock_wait_ns_(0)
+    {
+        existing_instance().store(this, std::memory_order_release);
+        std::clog.rdbuf(this);
+        std::clog << Severity() << Timestamp() << Tag() << Function() << Conditional() << AixLog::Color::NONE << std::flush;
+        // these would change the record if streamed, but are referenced to not warn about unused functions
+        (void)static_cast<std::ostream& (*)(std::ostream&, const Field&)>(&operator<<);
+        (void)static_cast<std::ostream& (*)(std::ostream&, Limiter&)>(&operator<<);
+        (void)static_cast<std::ostream& (*)(std::ostream&, const SourceLocation&)>(&operator<<);
+    }
+
+    /// pending lines are flushed by their threads on exit, see "record()"
+    virtual ~Log()
+    {
+        {
+            std::lock_guard<std::recursive_mutex> lock(mutex_);
+            flush_dedup();
+            flush_limiters();
+            for (const auto& sink : log_sinks_)
+                sink->flush();
+            existing_instance().store(nullptr, std::memory_order_release);
+            Epoch::retire(snapshot_.exchange(nullptr, std::memory_order_seq_cst));
+            for (const auto& sink : log_sinks_)
+                registered(*sink, false);
+            log_sinks_.clear();
+        }
+        // destroys the sinks that are only referenced by snapshots, which flushes their buffers
+        Epoch::drain();
+    }
+
+    int sync() override
+    {
+        Record& rec = record();
+        if (!rec.message.empty())
+        {
+            if (rec.do_log)
+                dispatch(view_of(rec));
+            rec.message.clear();
+            rec.metadata.fields.clear();
+        }
+
+        return 0;
+    }
+
+    int overflow(int c) override
+    {
+        if (c != EOF)
+        {
+            if (c == '\n')
+            {
+                sync();
+            }
+            else
+            {
+                Record& rec = record();
+                if (rec.do_log)
+                    rec.message.push_back(static_cast<char>(c));
+            }
+        }
+        else
+        {
+            sync();
+        }
+        return c;
+    }
+
+    /// Bulk write, used by the stream for strings. clog's streambuf is shared by all threads, so it has no put area
+    /// (setp) and the text goes into the thread's record: newlines are searched over the whole chunk with memchr and
+    /// the text in between is appended in one go, instead of taking the "overflow" path for every character.
+    std::streamsize xsputn(const char* s, std::streamsize count) override
+    {
+        const char* end = s + count;
+        while (s != end)
+        {
+            const char* newline = static_cast<const char*>(std::memchr(s, '\n', static_cast<size_t>(end - s)));
+            Record& rec = record();
+            if (rec.do_log)
+                rec.message.append(s, (newline != nullptr) ? newline : end);
+            if (newline == nullptr)
+                break;
+            sync();
+            s = newline + 1;
+        }
+        return count;
+    }
+
+private:
+    friend std::ostream& operator<<(std::ostream& os, const Severity& log_severity);
+    friend std::ostream& operator<<(std::ostream& os, const Timestamp& timestamp);
+    friend std::ostream& operator<<(std::ostream& os, const Tag& tag);
+    friend std::ostream& operator<<(std::ostream& os, const Function& function);
+    friend std::ostream& operator<<(std::ostream& os, const SourceLocation& location);
+    friend std::ostream& operator<<(std::ostream& os, const Conditional& conditional);
+    friend std::ostream& operator<<(std::ostream& os, const Field& field);
+    friend std::ostream& operator<<(std::ostream& os, Limiter& limiter);
+    friend void on_call_site_changed(CallSite& call_site);
+    friend class Scope;
+
+    /// Count the sink's entries in "log_sinks_" in its filter, so that the filter publishes its changes
+    static void registered(Sink& sink, bool added)
+    {
+        if (added)
+            sink.filter.registration_.sinks.fetch_add(1, std::memory_order_relaxed);
+        else
+            sink.filter.registration_.sinks.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    /// The sinks and their filters as used for dispatching. Replaced as a whole on changes (see "update_filters"),
+    /// so that "dispatch" reads it without taking Log's lock.
+    struct Snapshot
+    {
+        struct Entry
+        {
+            log_sink_ptr sink;
+            /// copy of the sink's filter, sharing its limiters
+            Filter filter;
+        };
+
+        Snapshot() : dedup(false)
+        {
+        }
+
+        std::vector<Entry> sinks;
+        /// "dedup_" is set, lines must go through it with Log's lock
+        bool dedup;
+    };
+
+    /// The line that the thread has composed with LOG
+    static RecordView view_of(Record& rec)
+    {
+        if (rec.location_pending)
+            return RecordView(rec.metadata, rec.message, rec.location);
+        return RecordView(rec.metadata, rec.message);
+    }
+
+    void dispatch(const Metadata& metadata, const std::string& message)
+    {
+        dispatch(RecordView(metadata, message));
+    }
+
+    /// Forward a completed log line to all matching sinks.
+    /// Without deduplication no lock of Log is taken, the sinks are called with their own lock, if any.
+    void dispatch(const RecordView& line)
+    {
+        Scope* scope = record().scope;
+        if ((scope != nullptr) && scope->capture(line.metadata(), line.message()))
+            return;
+        Epoch::Reader reader;
+        const Snapshot* snapshot = snapshot_.load(std::memory_order_seq_cst);
+        if (snapshot == nullptr)
+            return;
+        Sink::Counters::add(lines_, 1);
+        if (snapshot->dedup)
+        {
+            std::unique_lock<std::recursive_mutex> lock = lock_measured(mutex_);
+            // re-read, "dedup_" might be switched off meanwhile
+            snapshot = snapshot_.load(std::memory_order_seq_cst);
+            if (dedup_ && !dedup_->pass(line.metadata(), line.message(), [this, snapshot](const Metadata& summary, const std::string& text) {
+                    dispatch_to_sinks(*snapshot, RecordView(summary, text));
+                }))
+                return;
+        }
+        dispatch_to_sinks(*snapshot, line);
+    }
+
+    /// Forward several lines at once: every sink gets the ones that pass its filter with one "log_batch" call.
+    /// Lines that go into a Scope or through the global Dedup are dispatched one by one.
+    void dispatch(const RecordView* lines, size_t count)
+    {
+        Epoch::Reader reader;
+        const Snapshot* snapshot = snapshot_.load(std::memory_order_seq_cst);
+        if (snapshot == nullptr)
+            return;
+        if ((record().scope != nullptr) || snapshot->dedup)
+        {
+            for (size_t n = 0; n < count; ++n)
+                dispatch(lines[n]);
+            return;
+        }
+
+        Sink::Counters::add(lines_, count);
+        Record& rec = record();
+        std::uint64_t outer_dispatch_id = rec.dispatch_id;
+        rec.dispatch_id = ++rec.dispatch_count;
+        bool timed = is_timed();
+        auto start = timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+        // the thread's buffer keeps its capacity, a sink that logs a batch itself meanwhile gets a new one
+        std::vector<RecordView> batch;
+        batch.swap(rec.batch);
+        batch.reserve(count);
+        for (const auto& entry : snapshot->sinks)
+        {
+            Sink& sink = *entry.sink;
+            batch.clear();
+            {
+                std::unique_lock<std::recursive_mutex> lock;
+                if (!sink.thread_safe())
+                    lock = lock_measured(sink.dispatch_mutex_);
+                for (size_t n = 0; n < count; ++n)
+                {
+                    const RecordView& line = lines[n];
+                    bool pass = match(entry.filter, line);
+                    if (pass && (entry.filter.limiter(line.tag_id) != nullptr))
+                    {
+                        // a summary of suppressed lines goes before this line
+                        if (!batch.empty())
+                            sink.log_batch(batch.data(), batch.size());
+                        batch.clear();
+                        pass = pass_limit(sink, entry.filter, line);
+                    }
+                    if (!pass)
+                    {
+                        sink.counters_.rejected();
+                        continue;
+                    }
+                    batch.push_back(line);
+                    sink.counters_.logged(line.text.size);
+                }
+                if (!batch.empty())
+                    sink.log_batch(batch.data(), batch.size());
+            }
+            if (timed)
+            {
+                auto end = std::chrono::steady_clock::now();
+                sink.counters_.timed(end - start);
+                start = end;
+            }
+        }
+        batch.clear();
+        rec.batch.swap(batch);
+        rec.dispatch_id = outer_dispatch_id;
+    }
+
+    /// LOGB lines are not deduplicated, but end a run of duplicates
+    void dispatch(const BinaryRecord& binary_record)
+    {
+        Scope* scope = record().scope;
+        if ((scope != nullptr) && scope->capture(binary_record.metadata(), binary_record.message()))
+            return;
+        Epoch::Reader reader;
+        const Snapshot* snapshot = snapshot_.load(std::memory_order_seq_cst);
+        if (snapshot == nullptr)
+            return;
+        Sink::Counters::add(lines_, 1);
+        if (snapshot->dedup)
+            flush_dedup();
+        dispatch_to_sinks(*snapshot, binary_record);
+    }
+
+    /// Emit the pending summary of the global Dedup, if any
+    void flush_dedup()
+    {
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        Epoch::Reader reader;
+        const Snapshot* snapshot = snapshot_.load(std::memory_order_seq_cst);
+        if (dedup_ && (snapshot != nullptr))
+        {
+            dedup_->flush([this, snapshot](const Metadata& summary, const std::string& text) { dispatch_to_sinks(*snapshot, RecordView(summary, text)); });
+            dedup_->reset();
+        }
+    }
+
+    template <typename Line>
+    void dispatch_to_sinks(const Snapshot& snapshot, const Line& line)
+    {
+        Record& rec = record();
+        std::uint64_t outer_dispatch_id = rec.dispatch_id;
+        rec.dispatch_id = ++rec.dispatch_count;
+        // the end of one sink's "log" is the start of the next one's
+        bool timed = is_timed();
+        auto start = timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+        for (const auto& entry : snapshot.sinks)
+        {
+            Sink& sink = *entry.sink;
+            if (!match(entry.filter, line))
+            {
+                sink.counters_.rejected();
+                continue;
+            }
+            {
+                std::unique_lock<std::recursive_mutex> lock;
+                if (!sink.thread_safe())
+                    lock = lock_measured(sink.dispatch_mutex_);
+                if (!pass_limit(sink, entry.filter, line))
+                {
+                    sink.counters_.rejected();
+                    continue;
+                }
+                write(sink, line);
+            }
+            sink.counters_.logged(size_of(line));
+            if (timed)
+            {
+                auto end = std::chrono::steady_clock::now();
+                sink.counters_.timed(end - start);
+                start = end;
+            }
+        }
+        rec.dispatch_id = outer_dispatch_id;
+    }
+
+    static bool match(const Filter& filter, const RecordView& line)
+    {
+        return filter.match(line.tag_id, line.severity);
+    }
+
+    static bool match(const Filter& filter, const BinaryRecord& binary_record)
+    {
+        return filter.match(binary_record.call_site.tag_id, binary_record.severity);
+    }
+
+    static void write(Sink& sink, const RecordView& line)
+    {
+        sink.log_record(line);
+    }
+
+    static void write(Sink& sink, const BinaryRecord& binary_record)
+    {
+        sink.log_binary(binary_record);
+    }
+
+    static size_t tag_id_of(const RecordView& line)
+    {
+        return line.tag_id;
+    }
+
+    static size_t tag_id_of(const BinaryRecord& binary_record)
+    {
+        return binary_record.call_site.tag_id;
+    }
+
+    static size_t size_of(const RecordView& line)
+    {
+        return line.text.size;
+    }
+
+    static size_t size_of(const BinaryRecord& binary_record)
+    {
+        return binary_record.data.size();
+    }
+
+    /// A line that matches a sink's filter must also pass the filter's limiter for its tag, if there is one
+    template <typename Line>
+    static bool pass_limit(Sink& sink, const Filter& filter, const Line& line)
+    {
+        Limiter* limiter = filter.limiter(tag_id_of(line));
+        if (limiter == nullptr)
+            return true;
+        if (!limiter->allow(line.severity, tag_id_of(line)))
+            return false;
+        std::uint64_t suppressed = limiter->take_suppressed();
+        if (suppressed > 0)
+        {
+            Metadata metadata;
+            std::string message;
+            suppressed_line(metadata, message, metadata_of(line), suppressed);
+            own_line([&sink, &metadata, &message] { sink.log(metadata, message); });
+        }
+        return true;
+    }
+
+    /// The summary of suppressed lines, logged with the metadata of the line that passed after them
+    static void suppressed_line(Metadata& summary, std::string& message, const Metadata& metadata, std::uint64_t suppressed)
+    {
+        summary.severity = metadata.severity;
+        summary.tag = metadata.tag;
+        summary.function = metadata.function;
+        summary.timestamp = metadata.timestamp;
+        summary.fields.assign(1, Field("suppressed", suppressed));
+        message.assign("suppressed ");
+        Format::append(message, suppressed);
+        message.append(" messages");
+    }
+
+    /// Log the summaries of lines that limiters suppressed after the last line they let through: those of the LOG statements
+    /// to all sinks, those of the sinks' filters to their sink
+    void flush_limiters()
+    {
+        std::lock_guard<std::recursive_mutex> lock(mutex_);
+        Metadata metadata;
+        std::string message;
+        for (Limiter* limiter = Limiter::first_call_site(); limiter != nullptr; limiter = limiter->next_call_site())
+        {
+            if (pending_line(metadata, message, *limiter))
+                dispatch(metadata, message);
+        }
+        for (const auto& sink : log_sinks_)
+        {
+            const Filter& filter = sink->filter;
+            for (size_t id = 0; id <= filter.limits_.size(); ++id)
+            {
+                Limiter* limiter = (id < filter.limits_.size()) ? filter.limits_[id].limiter.get() : filter.default_limit_.limiter.get();
+                if ((limiter == nullptr) || !pending_line(metadata, message, *limiter))
+                    continue;
+                std::unique_lock<std::recursive_mutex> sink_lock;
+                if (!sink->thread_safe())
+                    sink_lock = lock_measured(sink->dispatch_mutex_);
+                own_line([&sink, &metadata, &message] { sink->log(metadata, message); });
+            }
+        }
+    }
+
+    /// The summary of lines that "limiter" suppressed, with the severity and tag of the last one, timestamped now
+    /// @return false if there are none
+    static bool pending_line(Metadata& summary, std::string& message, Limiter& limiter)
+    {
+        std::uint64_t suppressed = limiter.take_suppressed();
+        if (suppressed == 0)
+            return false;
+        Metadata metadata;
+        metadata.severity = limiter.severity();
+        const char* tag = Tag::text_of(limiter.tag_id());
+        if (tag != nullptr)
+            metadata.tag = Tag(tag);
+        metadata.timestamp = Timestamp(std::chrono::system_clock::now());
+        suppressed_line(summary, message, metadata, suppressed);
+        return true;
+    }
+
+    static const Metadata& metadata_of(const RecordView& line)
+    {
+        return line.metadata();
+    }
+
+    static const Metadata& metadata_of(const BinaryRecord& binary_record)
+    {
+        return binary_record.metadata();
+    }
+
+    /// Every "timing_sample"th line is timed, picked by a hash to not alias with patterns like alternating severities
+    bool is_timed() const
+    {
+        return ((lines_.load(std::memory_order_relaxed) * 0x9E3779B97F4A7C15ull) >> 32) % SinkMetrics::timing_sample == 0;
+    }
+
+    /// Fill the metadata of a LOGF line and format its message, reusing the strings' capacity
+    template <typename T, typename... Args>
+    static void format(Metadata& metadata, std::string& message, const CallSite& call_site, Severity severity, const T& tag, const char* format,
+                       const Args&... args)
+    {
+        metadata.severity = severity;
+        // a string literal tag is already interned in the call site
+        if ((call_site.tag == nullptr) || !metadata.tag || (metadata.tag.id != call_site.tag_id))
+            metadata.tag = tag;
+        // the function is set from the call site only if a sink needs it, see RecordView
+        metadata.timestamp = Timestamp(std::chrono::system_clock::now());
+        metadata.fields.clear();
+        using expand = int[];
+        (void)expand{0, (add_field(metadata.fields, args), 0)...};
+        message.clear();
+        Format::format_to(message, format, args...);
+    }
+
+    static void add_field(std::vector<Field>& fields, const Field& field)
+    {
+        fields.push_back(field);
+    }
+
+    template <typename T>
+    static void add_field(std::vector<Field>& /*fields*/, const T& /*arg*/)
+    {
+    }
+
+    /// Take the logger's or a sink's lock. Only if it's contended, the time waiting for it is measured.
+    std::unique_lock<std::recursive_mutex> lock_measured(std::recursive_mutex& mutex)
+    {
+        std::unique_lock<std::recursive_mutex> lock(mutex, std::try_to_lock);
+        if (!lock.owns_lock())
+        {
+            auto start = std::chrono::steady_clock::now();
+            lock.lock();
+            auto wait = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            Sink::Counters::add(lock_waits_, 1);
+            Sink::Counters::add(lock_wait_ns_, static_cast<std::uint64_t>(wait));
+        }
+        return lock;
+    }
+
+    /// The calling thread's record, i.e. one buffer per thread to avoid mixed log lines.
+    /// It's created on first use, and pending text is flushed and the record freed when the thread exits.
+    static Record& record()
+    {
+        /// Owns the thread's record, destroyed on thread exit
+        struct Owner
+        {
+            Owner(Record*& current, bool& destroyed) : current_(current), destroyed_(destroyed)
+            {
+                current_ = &record_;
+            }
+
+            ~Owner()
+            {
+                if (!record_.message.empty())
+                    Log::instance().sync();
+                current_ = nullptr;
+                destroyed_ = true;
+            }
+
+            Record record_;
+            Record*& current_;
+            bool& destroyed_;
+        };
+
+        // trivially destructible, i.e. still valid while the thread's thread_locals are being destroyed
+        static thread_local Record* current = nullptr;
+        static thread_local bool destroyed = false;
+        if (current == nullptr)
+        {
+            if (destroyed)
+            {
+                // someone is logging from a d'tor that runs after the Owner is gone (e.g. of a static object).
+                // Give it a fresh record that will be leaked, instead of handing out a dead one.
+                current = new Record();
+            }
+            else
+            {
+                static thread_local Owner owner(current, destroyed);
+            }
+        }
+        return *current;
+    }
+
+    static std::atomic<Log*>& existing_instance()
+    {
+        static std::atomic<Log*> log(nullptr);
+        return log;
+    }
+
+    std::vector<log_sink_ptr> log_sinks_;
+    /// "log_sinks_" as used for dispatching, read in an Epoch::Reader
+    std::atomic<const Snapshot*> snapshot_;
+    std::recursive_mutex mutex_;
+    /// see "set_dedup", nullptr if off
+    std::unique_ptr<Dedup> dedup_;
+    /// see LogMetrics
+    std::atomic<std::uint64_t> lines_;
+    std::atomic<std::uint64_t> lock_waits_;
+    std::atomic<std::uint64_t> lock_wait_ns_;
+};
+
+inline void Sink::log_binary(const BinaryRecord& record)
+{
+    log_record(RecordView(record.metadata(), record.message()));
+}
+
+inline Scope::Scope(Severity trigger, size_t max_lines)
+    : trigger_(trigger), max_lines_(max_lines), outer_(Log::record().scope), size_(0), dropped_(0), failed_(false)
+{
+    Record& record = Log::record();
+    if (!record.scope_buffers.empty())
+    {
+        lines_.swap(record.scope_buffers.back());
+        record.scope_buffers.pop_back();
+    }
+    record.scope = this;
+}
+
+inline Scope::~Scope()
+{
+    Record& record = Log::record();
+    record.scope = outer_;
+    record.scope_buffers.emplace_back();
+    record.scope_buffers.back().swap(lines_);
+}
+
+inline void Scope::fail()
+{
+    if (failed_)
+        return;
+    failed_ = true;
+    Record& record = Log::record();
+    Log* log = Log::existing();
+    // the lines go to the outer scope, if any, or to the sinks
+    Scope* current = record.scope;
+    record.scope = outer_;
+    if ((size_ > 0) && (log != nullptr))
+    {
+        std::vector<RecordView> lines;
+        lines.swap(record.scope_lines);
+        lines.reserve(size_);
+        for (size_t n = 0; n < size_; ++n)
+            lines.emplace_back(lines_[n].metadata, lines_[n].message);
+        log->dispatch(lines.data(), lines.size());
+        lines.clear();
+        record.scope_lines.swap(lines);
+    }
+    if (dropped_ > 0)
+    {
+        Metadata metadata = (size_ > 0) ? lines_[size_ - 1].metadata : Metadata();
+        metadata.fields.assign(1, Field("dropped", static_cast<std::uint64_t>(dropped_)));
+        std::string message("scope dropped ");
+        Format::append(message, dropped_);
+        message.append(" lines");
+        if (log != nullptr)
+            log->dispatch(metadata, message);
+    }
+    record.scope = current;
+    size_ = 0;
+}
+
+static void on_filter_changed()
+{
+    Log* log = Log::existing();
+    if (log != nullptr)
+        log->update_filters();
+}
+
+/// Call sites stay enabled until the logger is created, so that LOG goes to clog
+static void on_call_site_changed(CallSite& call_site)
+{
+    Log* log = Log::existing();
+    if (log != nullptr)
+    {
+        std::lock_guard<std::recursive_mutex> lock(log->mutex_);
+        call_site.update(log->log_sinks_);
+    }
+}
+
+/**
+ * @brief
+ * Null log sink
+ *
+ * Discards all log messages
+ */
+struct SinkNull : public Sink
+{
+    SinkNull() : Sink(Filter())
+    {
+    }
+
+    void log(const Metadata& /*metadata*/, const std::string& /*message*/) override
+    {
+    }
+
+    void log_record(const RecordView& record) override
+    {
+        if (!own_log())
+            log(record.metadata(), record.message());
+    }
+
+    bool thread_safe() const override
+    {
+        return true;
+    }
+
+protected:
+    bool own_log() const override
+    {
+        return typeid(*this) == typeid(SinkNull);
+    }
+};
+
+
+/**
+ * @brief
+ * Abstract log sink with support for formatting log message
+ *
+ * "format" in the c'tor defines a log pattern.
+ * For every log message, these placeholders will be substituded:
+ * - strftime syntax is used to format the logging time stamp (%Y, %m, %d, ...)
+ * - #ms: milliseconds part of the logging time stamp with leading zeros
+ * - #us, #ns: microseconds and nanoseconds part of the logging time stamp with leading zeros
+ * - #severity: log severity
+ * - #color_severity: log severity in red
+ * - #tag_func: the log tag. If empty, the function
+ * - #tag: the log tag
+ * - #function: the function
+ * - #message: the log message. If missing, the message is appended, separated by a space
+ *
+ * The pattern is parsed once into a list of tokens, which are rendered for every log
+ * message into a reused buffer, i.e. without allocating in the steady state.
+ * "set_format" may be called while other threads log, the parsed pattern is replaced as a whole.
+ */
+struct SinkFormat : public Sink
+{
+    SinkFormat(const Filter& filter, const std::string& format) : Sink(filter), pattern_(compile(format))
+    {
+    }
+
+    SinkFormat(const SinkFormat& other) : Sink(other), pattern_(other.copy_pattern())
+    {
+    }
+
+    SinkFormat& operator=(const SinkFormat& other)
+    {
+        if (this != &other)
+        {
+            Sink::operator=(other);
+            Epoch::retire(pattern_.exchange(other.copy_pattern(), std::memory_order_seq_cst));
+        }
+        return *this;
+    }
+
+    ~SinkFormat() override
+    {
+        delete pattern_.load();
+    }
+
+    virtual void set_format(const std::string& format)
+    {
+        Epoch::retire(pattern_.exchange(compile(format), std::memory_order_seq_cst));
+    }
+
+    void log(const Metadata& metadata, const std::string& message) override = 0;
+
+protected:
+    virtual void do_log(std::ostream& stream, const Metadata& metadata, const std::string& message) const
+    {
+        stream << render(metadata, message) << std::endl;
+    }
+
+    /// Render the formatted log line (without line break) into a buffer that is reused for the next line.
+    /// While Log dispatches a line, sinks with the same format share the rendered line.
+    const std::string& render(const Metadata& metadata, const std::string& message) const
+    {
+        return render(RecordView(metadata, message));
+    }
+
+    const std::string& render(const RecordView& record) const
+    {
+        Epoch::Reader reader;
+        const Pattern& pattern = *pattern_.load(std::memory_order_seq_cst);
+        bool hit;
+        std::string* line = Log::shared_render(record, pattern.format, hit);
+        if (line == nullptr)
+            line = &line_;
+        else if (hit)
+            return *line;
+
+        render(*line, pattern, record);
+        return *line;
+    }
+
+    void render(std::string& line, const Metadata& metadata, const std::string& message) const
+    {
+        Epoch::Reader reader;
+        render(line, *pattern_.load(std::memory_order_seq_cst), RecordView(metadata, message));
+    }
+
+private:
+    struct Token
+    {
+        enum class Type
+        {
+            literal,
+            time,
+            severity,
+            color_severity,
+            tag_func,
+            tag,
+            function,
+            message,
+            appended_message,
+            fields
+        };
+
+        Token(Type type, const std::string& text = "") : type(type), text(text)
+        {
+        }
+
+        Type type;
+        /// literal text or strftime pattern
+        std::string text;
+    };
+
+    /// The parsed format
+    struct Pattern
+    {
+        std::string format;
+        std::vector<Token> tokens;
+    };
+
+    void render(std::string& line, const Pattern& pattern, const RecordView& record) const
+    {
+        line.clear();
+        for (const auto& token : pattern.tokens)
+        {
+            switch (token.type)
+            {
+                case Token::Type::literal:
+                    line.append(token.text);
+                    break;
+                case Token::Type::time:
+                    if (record.timestamp)
+                        record.timestamp.append_to(line, token.text);
+                    else
+                        line.append(token.text);
+                    break;
+                case Token::Type::severity:
+                    line.append(to_string(record.severity));
+                    break;
+                case Token::Type::color_severity:
+                    line.append("\033[31m").append(to_string(record.severity)).append("\033[0m");
+                    break;
+                case Token::Type::tag_func:
+                    if (record.tag)
+                        line.append(record.tag.data, record.tag.size);
+                    else if (record.function)
+                        line.append(record.function.data, record.function.size);
+                    else
+                        line.append("log");
+                    break;
+                case Token::Type::tag:
+                    if (record.tag)
+                        line.append(record.tag.data, record.tag.size);
+                    break;
+                case Token::Type::function:
+                    if (record.function)
+                        line.append(record.function.data, record.function.size);
+                    break;
+                case Token::Type::message:
+                    line.append(record.text.data, record.text.size);
+                    break;
+                case Token::Type::fields:
+                    for (const Field* field = record.fields; field != record.fields + record.fields_size; ++field)
+                    {
+                        if (field != record.fields)
+                            line.push_back(' ');
+                        line.append(field->key).push_back('=');
+                        field->append_value(line);
+                    }
+                    break;
+                case Token::Type::appended_message:
+                    if (!line.empty() && (line.back() != ' '))
+                        line.push_back(' ');
+                    line.append(record.text.data, record.text.size);
+                    break;
+            }
+        }
+    }
+
+    static const Pattern* compile(const std::string& format)
+    {
+        // longer placeholders first, "#tag" is a prefix of "#tag_func"
+        static const std::vector<std::pair<std::string, Token::Type>> placeholders = {
+            {"#color_severity", Token::Type::color_severity},
+            {"#severity", Token::Type::severity},
+            {"#tag_func", Token::Type::tag_func},
+            {"#tag", Token::Type::tag},
+            {"#function", Token::Type::function},
+            {"#message", Token::Type::message},
+            {"#fields", Token::Type::fields}};
+
+        auto pattern = new Pattern();
+        pattern->format = format;
+        auto& tokens = pattern->tokens;
+        bool has_message = false;
+        std::string text;
+        auto add_text = [&tokens, &text]() {
+            if (text.empty())
+                return;
+            bool is_time = (text.find_first_of("%#") != std::string::npos);
+            tokens.emplace_back(is_time ? Token::Type::time : Token::Type::literal, text);
+            text.clear();
+        };
+
+        for (size_t pos = 0; pos < format.size();)
+        {
+            auto placeholder = placeholders.end();
+            if (format[pos] == '#')
+            {
+                placeholder = std::find_if(placeholders.begin(), placeholders.end(),
+                                           [&](const std::pair<std::string, Token::Type>& p) { return format.compare(pos, p.first.size(), p.first) == 0; });
+            }
+
+            if (placeholder == placeholders.end())
+            {
+                text.push_back(format[pos++]);
+                continue;
+            }
+
+            add_text();
+            tokens.emplace_back(placeholder->second);
+            has_message |= (placeholder->second == Token::Type::message);
+            pos += placeholder->first.size();
+        }
+        add_text();
+        if (!has_message)
+            tokens.emplace_back(Token::Type::appended_message);
+        return pattern;
+    }
+
+    const Pattern* copy_pattern() const
+    {
+        Epoch::Reader reader;
+        return new Pattern(*pattern_.load(std::memory_order_seq_cst));
+    }
+
+    std::atomic<const Pattern*> pattern_;
+    mutable std::string line_;
+};
+
+/**
+ * @brief
+ * Formatted logging to cout
+ */
+struct SinkCout : public SinkFormat
+{
+    SinkCout(const Filter& filter, const std::string& format = "%Y-%m-%d %H-%M-%S.#ms [#severity] (#tag_func)") : SinkFormat(filter, format)
+    {
+    }
+
+    void log(const Metadata& metadata, const std::string& message) override
+    {
+        do_log(std::cout, metadata, message);
+    }
+};
+
+/**
+ * @brief
+ * Formatted logging to cerr
+ */
+struct SinkCerr : public SinkFormat
+{
+    SinkCerr(const Filter& filter, const std::string& format = "%Y-%m-%d %H-%M-%S.#ms [#severity] (#tag_func)") : SinkFormat(filter, format)
+    {
+    }
+
+    void log(const Metadata& metadata, const std::string& message) override
+    {
+        do_log(std::cerr, metadata, message);
+    }
+};
+
+/**
+ * @brief
+ * Formatted logging to file
+ *
+ * Log lines are collected in a buffer and written with a single write call per batch.
+ * The FlushPolicy decides when the buffer is written, by default after every line.
+ * If it has an interval, a background thread writes lines that have been buffered for that long.
+ * Everything is written on "flush" and on destruction.
+ */
+struct SinkFile : public SinkFormat
+{
+    struct FlushPolicy
+    {
+        /// @param bytes write when at least this many bytes are buffered, 0: after every line
+        /// @param interval write when the oldest buffered line is older, 0: never. Checked by a background thread.
+        /// @param severity write immediately after a line with this or a higher severity
+        FlushPolicy(size_t bytes = 0, std::chrono::milliseconds interval = std::chrono::milliseconds(0), Severity severity = Severity::trace)
+            : bytes(bytes), interval(interval), severity(severity)
+        {
+        }
+
+        /// Write after every line (default)
+        static FlushPolicy every_line()
+        {
+            return FlushPolicy();
+        }
+
+        /// Write every 64kB, after one second, and on errors
+        static FlushPolicy buffered(size_t bytes = 64 * 1024, std::chrono::milliseconds interval = std::chrono::milliseconds(1000),
+                                    Severity severity = Severity::error)
+        {
+            return FlushPolicy(bytes, interval, severity);
+        }
+
+        /// Write only on "flush" and on destruction
+        static FlushPolicy explicit_only()
+        {
+            return FlushPolicy(std::numeric_limits<size_t>::max(), std::chrono::milliseconds(0), static_cast<Severity>(std::numeric_limits<std::int8_t>::max()));
+        }
+
+        size_t bytes;
+        std::chrono::milliseconds interval;
+        Severity severity;
+    };
+
+    SinkFile(const Filter& filter, const std::string& filename, const std::string& format = "%Y-%m-%d %H-%M-%S.#ms [#severity] (#tag_func)",
+             const FlushPolicy& flush_policy = FlushPolicy())
+        : SinkFile(filter, filename, format, flush_policy, std::ofstream::out | std::ofstream::trunc)
+    {
+    }
+
+    ~SinkFile() override
+    {
+        stop_timer();
+        flush();
+        ofs.close();
+    }
+
+    void log(const Metadata& metadata, const std::string& message) override
+    {
+        log_line(RecordView(metadata, message));
+    }
+
+    void log_record(const RecordView& record) override
+    {
+        if (own_log())
+            log_line(record);
+        else
+            log(record.metadata(), record.message());
+    }
+
+    /// The lines are written with a single write, unless they exceed the flush policy's size
+    void log_batch(const RecordView* records, size_t count) override
+    {
+        if (!own_log())
+        {
+            Sink::log_batch(records, count);
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        Severity severity = Severity::trace;
+        for (size_t n = 0; n < count; ++n)
+        {
+            buffering();
+            append_line(records[n]);
+            severity = std::max(severity, records[n].severity);
+            if ((flush_policy_.bytes > 0) && (buffer_.size() >= flush_policy_.bytes))
+                write();
+        }
+        buffered(severity);
+    }
+
+    void flush() override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        write();
+        ofs.flush();
+    }
+
+    /// Lines are appended with "mutex_" locked
+    bool thread_safe() const override
+    {
+        return true;
+    }
+
+protected:
+    SinkFile(const Filter& filter, const std::string& filename, const std::string& format, const FlushPolicy& flush_policy, std::ios_base::openmode mode)
+        : SinkFormat(filter, format), flush_policy_(flush_policy), timer_stop_(false)
+    {
+        open(filename, mode);
+        if ((flush_policy_.bytes > 0) && (flush_policy_.bytes < std::numeric_limits<size_t>::max()))
+            buffer_.reserve(flush_policy_.bytes + 1024);
+        if (flush_policy_.interval.count() > 0)
+            timer_ = std::thread(&SinkFile::timer, this);
+    }
+
+    /// Buffer a line, without going through the virtual "log" or "log_record"
+    void log_line(const RecordView& record)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        buffering();
+        append_line(record);
+        buffered(record.severity);
+    }
+
+    /// Stop the thread that writes on the flush policy's interval. Subclasses that override "write" call it first in their d'tor.
+    void stop_timer()
+    {
+        if (!timer_.joinable())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            timer_stop_ = true;
+        }
+        timer_cv_.notify_one();
+        timer_.join();
+    }
+
+    void open(const std::string& filename, std::ios_base::openmode mode)
+    {
+        // unbuffered, "buffer_" is written with one call
+        ofs.rdbuf()->pubsetbuf(nullptr, 0);
+        ofs.open(filename.c_str(), mode);
+    }
+
+    bool own_log() const override
+    {
+        return typeid(*this) == typeid(SinkFile);
+    }
+
+    /// Add a line to "buffer_", called with "mutex_" locked
+    virtual void append_line(const RecordView& record)
+    {
+        buffer_.append(render(record)).push_back('\n');
+    }
+
+    /// Call with "mutex_" locked before a line is added to "buffer_"
+    void buffering()
+    {
+        if (buffer_.empty() && (flush_policy_.interval.count() > 0))
+        {
+            first_buffered_ = std::chrono::steady_clock::now();
+            timer_cv_.notify_one();
+        }
+    }
+
+    /// Call with "mutex_" locked after a line is added to "buffer_", writes it if the flush policy says so
+    void buffered(Severity severity)
+    {
+        if ((buffer_.size() >= flush_policy_.bytes) || (severity >= flush_policy_.severity) ||
+            ((flush_policy_.interval.count() > 0) && (std::chrono::steady_clock::now() - first_buffered_ >= flush_policy_.interval)))
+            write();
+    }
+
+    /// Write the buffer to the file, called with "mutex_" locked
+    virtual void write()
+    {
+        if (buffer_.empty())
+            return;
+        ofs.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+        buffer_.clear();
+    }
+
+    mutable std::ofstream ofs;
+    FlushPolicy flush_policy_;
+    std::string buffer_;
+    std::chrono::steady_clock::time_point first_buffered_;
+    std::mutex mutex_;
+
+private:
+    /// Writes the buffer once its oldest line is older than the flush policy's interval
+    void timer()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!timer_stop_)
+        {
+            if (buffer_.empty())
+                timer_cv_.wait(lock);
+            else if (std::chrono::steady_clock::now() - first_buffered_ >= flush_policy_.interval)
+                write();
+            else
+                timer_cv_.wait_until(lock, first_buffered_ + flush_policy_.interval);
+        }
+    }
+
+    bool timer_stop_;
+    std::condition_variable timer_cv_;
+    std::thread timer_;
+};
+
+/**
+ * @brief
+ * Formatted logging to a file that is rotated by size and/or time
+ *
+ * The file is rolled over when it would grow beyond "max_size" bytes, and when a wall clock
+ * "interval" boundary (e.g. every full hour) has passed. A background thread opens the next file
+ * in advance as "filename.next", so that the logging thread only swaps the streams. The background
+ * thread then closes the retired file, renames the new one to "filename", moves the retired one to
+ * "filename.1", shifts the older generations ("filename.2", ...), deletes the ones beyond "max_files"
+ * and optionally compresses it, e.g. with "SinkRotatingFile::gzip" if AIXLOG_USE_ZLIB is defined.
+ * Until the next file is opened, a due rotation is postponed and the lines go to the current file.
+ */
+struct SinkRotatingFile : public SinkFile
+{
+    struct Rotation
+    {
+        /// @param max_size rotate when the file would grow beyond this size, 0: never
+        /// @param interval rotate on every wall clock multiple of the interval (UTC), 0: never
+        /// @param max_files number of retired generations to keep
+        Rotation(size_t max_size = 10 * 1024 * 1024, std::chrono::seconds interval = std::chrono::seconds(0), size_t max_files = 5)
+            : max_size(max_size), interval(interval), max_files(max_files), compression_suffix(".gz")
+        {
+        }
+
+        size_t max_size;
+        std::chrono::seconds interval;
+        size_t max_files;
+        /// Compress "source" into "destination", runs in the background thread. Not set: no compression.
+        std::function<bool(const std::string& source, const std::string& destination)> compress;
+        /// Appended to the name of compressed generations
+        std::string compression_suffix;
+    };
+
+    SinkRotatingFile(const Filter& filter, const std::string& filename, const Rotation& rotation = Rotation(),
+                     const std::string& format = "%Y-%m-%d %H-%M-%S.#ms [#severity] (#tag_func)", const FlushPolicy& flush_policy = FlushPolicy())
+        : SinkFile(filter, filename, format, flush_policy, std::ofstream::out | std::ofstream::app), filename_(filename), rotation_(rotation),
+          rotations_(0), stop_(false)
+    {
+        ofs.seekp(0, std::ios_base::end);
+        auto pos = ofs.tellp();
+        written_ = (pos > 0) ? static_cast<size_t>(pos) : 0;
+        next_rotation_ = next_rotation(std::chrono::system_clock::now());
+        if ((rotation_.max_size > 0) || (rotation_.interval.count() > 0))
+            worker_ = std::thread(&SinkRotatingFile::worker, this);
+    }
+
+    ~SinkRotatingFile() override
+    {
+        stop_timer();
+        flush();
+        {
+            std::lock_guard<std::mutex> lock(retired_mutex_);
+            stop_ = true;
+        }
+        retired_cv_.notify_one();
+        if (worker_.joinable())
+            worker_.join();
+        if (next_)
+        {
+            next_->close();
+            std::remove(next_filename().c_str());
+        }
+    }
+
+#ifdef AIXLOG_USE_ZLIB
+    /// Compressor for Rotation::compress, needs zlib
+    static bool gzip(const std::string& source, const std::string& destination)
+    {
+        std::ifstream in(source.c_str(), std::ios_base::binary);
+        gzFile out = gzopen(destination.c_str(), "wb");
+        if (!in || (out == nullptr))
+        {
+            if (out != nullptr)
+                gzclose(out);
+            return false;
+        }
+
+        char buffer[64 * 1024];
+        bool ok = true;
+        while (ok && in)
+        {
+            in.read(buffer, sizeof(buffer));
+            if (in.gcount() > 0)
+                ok = (gzwrite(out, buffer, static_cast<unsigned>(in.gcount())) == static_cast<int>(in.gcount()));
+        }
+        return (gzclose(out) == Z_OK) && ok;
+    }
+#endif
+
+protected:
+    bool own_log() const override
+    {
+        return typeid(*this) == typeid(SinkRotatingFile);
+    }
+
+    void write() override
+    {
+        if (buffer_.empty())
+            return;
+
+        bool by_size = (rotation_.max_size > 0) && (written_ > 0) && (written_ + buffer_.size() > rotation_.max_size);
+        bool by_time = (rotation_.interval.count() > 0) && (std::chrono::system_clock::now() >= next_rotation_);
+        if (by_size || by_time)
+            rotate();
+
+        written_ += buffer_.size();
+        SinkFile::write();
+    }
+
+private:
+    std::chrono::system_clock::time_point next_rotation(const std::chrono::system_clock::time_point& now) const
+    {
+        if (rotation_.interval.count() <= 0)
+            return std::chrono::system_clock::time_point::max();
+        auto interval = std::chrono::duration_cast<std::chrono::system_clock::duration>(rotation_.interval);
+        return std::chrono::system_clock::time_point((now.time_since_epoch() / interval + 1) * interval);
+    }
+
+    /// Swap in the file that the worker opened in advance, everything else is done by the worker.
+    /// Postponed if the worker hasn't opened it yet.
+    void rotate()
+    {
+        std::unique_ptr<std::ofstream> stream;
+        {
+            std::lock_guard<std::mutex> lock(retired_mutex_);
+            stream.swap(next_);
+        }
+        if (!stream)
+            return;
+
+        ofs.swap(*stream);
+        written_ = 0;
+        next_rotation_ = next_rotation(std::chrono::system_clock::now());
+        {
+            std::lock_guard<std::mutex> lock(retired_mutex_);
+            retired_.push_back(std::move(stream));
+        }
+        retired_cv_.notify_one();
+    }
+
+    std::string generation(size_t n, bool compressed) const
+    {
+        return filename_ + "." + std::to_string(n) + (compressed ? rotation_.compression_suffix : "");
+    }
+
+    std::string next_filename() const
+    {
+        return filename_ + ".next";
+    }
+
+    /// Open the file that "rotate" swaps in, called by the worker
+    void open_next()
+    {
+        std::unique_ptr<std::ofstream> stream(new std::ofstream());
+        // unbuffered, see SinkFile::open
+        stream->rdbuf()->pubsetbuf(nullptr, 0);
+        stream->open(next_filename().c_str(), std::ofstream::out | std::ofstream::trunc);
+        if (!stream->is_open())
+            return;
+        std::lock_guard<std::mutex> lock(retired_mutex_);
+        next_ = std::move(stream);
+    }
+
+    void worker()
+    {
+        open_next();
+        std::unique_lock<std::mutex> lock(retired_mutex_);
+        for (;;)
+        {
+            retired_cv_.wait(lock, [this] { return stop_ || !retired_.empty(); });
+            if (retired_.empty())
+                return;
+            std::unique_ptr<std::ofstream> stream = std::move(retired_.front());
+            retired_.erase(retired_.begin());
+            lock.unlock();
+
+            // the lines go to "filename.next" since the swap, give it the real name
+            stream->close();
+            std::string retired = filename_ + ".rotating." + std::to_string(++rotations_);
+            std::rename(filename_.c_str(), retired.c_str());
+            std::rename(next_filename().c_str(), filename_.c_str());
+            open_next();
+
+            // shift the generations: filename.n-1 => filename.n, ..., filename => filename.1
+            size_t max_files = std::max<size_t>(rotation_.max_files, 1);
+            for (bool compressed : {false, true})
+            {
+                std::remove(generation(max_files, compressed).c_str());
+                for (size_t n = max_files - 1; n > 0; --n)
+                    std::rename(generation(n, compressed).c_str(), generation(n + 1, compressed).c_str());
+            }
+            std::rename(retired.c_str(), generation(1, false).c_str());
+
+            if (rotation_.compress && rotation_.compress(generation(1, false), generation(1, true)))
+                std::remove(generation(1, false).c_str());
+
+            lock.lock();
+        }
+    }
+
+    std::string filename_;
+    Rotation rotation_;
+    size_t written_;
+    std::chrono::system_clock::time_point next_rotation_;
+    /// used by the worker only
+    size_t rotations_;
+    /// streams of retired files, closed by the worker
+    std::vector<std::unique_ptr<std::ofstream>> retired_;
+    /// the file that "rotate" swaps in, opened by the worker
+    std::unique_ptr<std::ofstream> next_;
+    bool stop_;
+    std::mutex retired_mutex_;
+    std::condition_variable retired_cv_;
+    std::thread worker_;
+};
+
+/**
+ * @brief
+ * Binary logging to a file, to be decoded with aixlog_decode
+ *
+ * LOGB lines are stored unformatted as call site id, severity, timestamp and the binary encoded arguments.
+ * The static data of a call site (file, line, function, tag, format, argument types) is stored once, before
+ * its first line. Other log lines are stored with their message text. "format" is stored in the header and
+ * is what aixlog_decode renders the lines with by default.
+ *
+ * File format version 1, numbers are in the byte order of the writer, strings are u32 length + characters:
+ * header:    "AXLB", u16 version, u16 0x0102, string format
+ * call site: u8 1, u32 id, u32 line, string file, string function, u8 has_tag, string tag, string format, string types
+ * binary:    u8 2, u32 call site id, i8 severity, i64 timestamp (ns since epoch), u32 size, arguments (see BinaryArg)
+ * text:      u8 3, i8 severity, u8 flags (1: tag, 2: function, 4: timestamp), i64 timestamp, string tag, string function, string file,
+ *            u32 line, string message
+ */
+struct SinkBinary : public SinkFile
+{
+    static const std::uint16_t version = 1;
+
+    SinkBinary(const Filter& filter, const std::string& filename, const std::string& format = "%Y-%m-%d %H-%M-%S.#ms [#severity] (#tag_func)",
+               const FlushPolicy& flush_policy = FlushPolicy::buffered())
+        : SinkFile(filter, filename, format, flush_policy, std::ofstream::out | std::ofstream::trunc | std::ofstream::binary)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        buffer_.append("AXLB", 4);
+        binary_put(buffer_, static_cast<std::uint16_t>(version));
+        binary_put(buffer_, std::uint16_t(0x0102));
+        put_string(buffer_, format);
+        write();
+    }
+
+    void log_binary(const BinaryRecord& record) override
+    {
+        const CallSite& call_site = record.call_site;
+        std::lock_guard<std::mutex> lock(mutex_);
+        buffering();
+        if (call_site.id >= sites_.size())
+            sites_.resize(call_site.id + 1, false);
+        if (!sites_[call_site.id])
+        {
+            sites_[call_site.id] = true;
+            binary_put(buffer_, Entry::call_site);
+            binary_put(buffer_, call_site.id);
+            binary_put(buffer_, static_cast<std::uint32_t>(call_site.line));
+            put_string(buffer_, call_site.file);
+            put_string(buffer_, call_site.function);
+            binary_put(buffer_, static_cast<std::uint8_t>((call_site.tag != nullptr) ? 1 : 0));
+            put_string(buffer_, (call_site.tag != nullptr) ? call_site.tag : "");
+            put_string(buffer_, record.format);
+            put_string(buffer_, record.types);
+        }
+        binary_put(buffer_, Entry::binary);
+        binary_put(buffer_, call_site.id);
+        binary_put(buffer_, static_cast<std::int8_t>(record.severity));
+        binary_put(buffer_, to_ns(record.timestamp));
+        binary_put(buffer_, static_cast<std::uint32_t>(record.data.size()));
+        buffer_.append(record.data);
+        buffered(record.severity);
+    }
+
+    /// Read a file that was written by SinkBinary and pass its lines to "handler"
+    /// @param format set to the format from the header, before the first line is passed
+    /// @return false if it's not a binary log of this version, or if it's truncated
+    static bool decode(std::istream& in, std::string& format, const std::function<void(const Metadata& metadata, const std::string& message)>& handler)
+    {
+        char magic[4];
+        std::uint16_t file_version;
+        std::uint16_t byte_order;
+        if (!in.read(magic, sizeof(magic)) || (std::memcmp(magic, "AXLB", sizeof(magic)) != 0) || !get(in, file_version) || (file_version != version) ||
+            !get(in, byte_order) || (byte_order != 0x0102) || !get_string(in, format))
+            return false;
+
+        struct Site
+        {
+            std::uint32_t line;
+            std::string file;
+            std::string function;
+            std::uint8_t has_tag;
+            std::string tag;
+            std::string format;
+            std::string types;
+        };
+        std::map<std::uint32_t, Site> sites;
+
+        Entry entry;
+        while (get(in, entry))
+        {
+            Metadata metadata;
+            std::string message;
+            std::uint32_t id;
+            std::int8_t severity;
+            std::int64_t ns;
+            if (entry == Entry::call_site)
+            {
+                Site site;
+                if (!get(in, id) || !get(in, site.line) || !get_string(in, site.file) || !get_string(in, site.function) || !get(in, site.has_tag) ||
+                    !get_string(in, site.tag) || !get_string(in, site.format) || !get_string(in, site.types))
+                    return false;
+                sites[id] = std::move(site);
+                continue;
+            }
+            else if (entry == Entry::binary)
+            {
+                std::string data;
+                auto iter = sites.end();
+                if (!get(in, id) || ((iter = sites.find(id)) == sites.end()) || !get(in, severity) || !get(in, ns) || !get_string(in, data))
+                    return false;
+                const Site& site = iter->second;
+                metadata.tag = site.has_tag ? Tag(site.tag) : Tag(nullptr);
+                metadata.function = Function(site.function, site.file, site.line);
+                metadata.timestamp = Timestamp(from_ns(ns));
+                if (!BinaryRecord::format_message(message, site.format.c_str(), site.types.c_str(), data.data(), data.size()))
+                    return false;
+            }
+            else if (entry == Entry::text)
+            {
+                std::uint8_t flags;
+                std::string tag;
+                std::string function;
+                std::string file;
+                std::uint32_t line;
+                if (!get(in, severity) || !get(in, flags) || !get(in, ns) || !get_string(in, tag) || !get_string(in, function) || !get_string(in, file) ||
+                    !get(in, line) || !get_string(in, message))
+                    return false;
+                if ((flags & 1) != 0)
+                    metadata.tag = Tag(tag);
+                if ((flags & 2) != 0)
+                    metadata.function = Function(function, file, line);
+                if ((flags & 4) != 0)
+                    metadata.timestamp = Timestamp(from_ns(ns));
+            }
+            else
+            {
+                return false;
+            }
+            metadata.severity = static_cast<Severity>(severity);
+            handler(metadata, message);
+        }
+        return in.eof() && (in.gcount() == 0);
+    }
+
+protected:
+    bool own_log() const override
+    {
+        return typeid(*this) == typeid(SinkBinary);
+    }
+
+    void append_line(const RecordView& record) override
+    {
+        binary_put(buffer_, Entry::text);
+        binary_put(buffer_, static_cast<std::int8_t>(record.severity));
+        binary_put(buffer_, static_cast<std::uint8_t>((record.tag ? 1 : 0) | (record.function ? 2 : 0) | (record.timestamp ? 4 : 0)));
+        binary_put(buffer_, to_ns(record.timestamp.time_point));
+        put_string(buffer_, record.tag);
+        put_string(buffer_, record.function);
+        put_string(buffer_, record.file);
+        binary_put(buffer_, static_cast<std::uint32_t>(record.line));
+        put_string(buffer_, record.text);
+    }
+
+private:
+    enum class Entry : std::uint8_t
+    {
+        call_site = 1,
+        binary = 2,
+        text = 3
+    };
+
+    static std::int64_t to_ns(const std::chrono::system_clock::time_point& time_point)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(time_point.time_since_epoch()).count();
+    }
+
+    static std::chrono::system_clock::time_point from_ns(std::int64_t ns)
+    {
+        return std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(ns)));
+    }
+
+    static void put_string(std::string& buffer, const std::string& text)
+    {
+        put_string(buffer, RecordView::Text(text));
+    }
+
+    static void put_string(std::string& buffer, const RecordView::Text& text)
+    {
+        binary_put(buffer, static_cast<std::uint32_t>(text.size));
+        if (text.size > 0)
+            buffer.append(text.data, text.size);
+    }
+
+    template <typename T>
+    static bool get(std::istream& in, T& value)
+    {
+        return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+    }
+
+    static bool get_string(std::istream& in, std::string& text)
+    {
+        std::uint32_t size;
+        if (!get(in, size))
+            return false;
+        text.resize(size);
+        return (size == 0) || static_cast<bool>(in.read(&text[0], size));
+    }
+
+    /// call sites that are already described in the file, by id
+    std::vector<bool> sites_;
+};
+
+/**
+ * @brief
+ * Structured logging to a file, one JSON object per line ("JSON lines")
+ *
+ * {"time":"...","severity":"Info","tag":"...","function":"...","file":"...","line":42,"message":"...","fields":{"key":value,...}}
+ * Members without a value (no tag, no function, no fields) are left out. Strings are escaped, but not validated as UTF-8.
+ */
+struct SinkJson : public SinkFile
+{
+    /// @param time_format strftime format + "#ms", "#us", "#ns", see Timestamp::to_string
+    SinkJson(const Filter& filter, const std::string& filename, const std::string& time_format = "%Y-%m-%dT%H:%M:%S.#us%z",
+             const FlushPolicy& flush_policy = FlushPolicy())
+        : SinkFile(filter, filename, "#message", flush_policy), time_format_(time_format)
+    {
+    }
+
+    /// Append the JSON object of a log line (without line break) to "json"
+    static void to_json(std::string& json, const Metadata& metadata, const std::string& message, const std::string& time_format)
+    {
+        to_json(json, RecordView(metadata, message), time_format);
+    }
+
+    static void to_json(std::string& json, const RecordView& record, const std::string& time_format)
+    {
+        json.push_back('{');
+        if (record.timestamp)
+        {
+            json.append("\"time\":\"");
+            size_t begin = json.size();
+            record.timestamp.append_to(json, time_format);
+            if (find_escape(json.data() + begin, json.data() + json.size()) != json.data() + json.size())
+            {
+                std::string time(json, begin);
+                json.resize(begin);
+                append_escaped(json, time.data(), time.size());
+            }
+            json.append("\",");
+        }
+        json.append("\"severity\":\"").append(to_string(record.severity)).push_back('"');
+        if (record.tag)
+            append_member(json, "tag", record.tag);
+        if (record.function)
+        {
+            append_member(json, "function", record.function);
+            append_member(json, "file", record.file);
+            json.append(",\"line\":");
+            Format::append(json, record.line);
+        }
+        append_member(json, "message", record.text);
+        if (record.fields_size > 0)
+        {
+            json.append(",\"fields\":{");
+            for (const Field* field = record.fields; field != record.fields + record.fields_size; ++field)
+            {
+                if (field != record.fields)
+                    json.push_back(',');
+                append_string(json, field->key, std::strlen(field->key));
+                json.push_back(':');
+                append_value(json, *field);
+            }
+            json.push_back('}');
+        }
+        json.push_back('}');
+    }
+
+    /// Append "text" as quoted JSON string
+    static void append_string(std::string& json, const char* text, size_t size)
+    {
+        json.push_back('"');
+        append_escaped(json, text, size);
+        json.push_back('"');
+    }
+
+protected:
+    bool own_log() const override
+    {
+        return typeid(*this) == typeid(SinkJson);
+    }
+
+    void append_line(const RecordView& record) override
+    {
+        to_json(buffer_, record, time_format_);
+        buffer_.push_back('\n');
+    }
+
+    static void append_member(std::string& json, const char* name, const std::string& value)
+    {
+        append_member(json, name, RecordView::Text(value));
+    }
+
+    static void append_member(std::string& json, const char* name, const RecordView::Text& value)
+    {
+        json.append(",\"").append(name).append("\":");
+        append_string(json, value.data, value.size);
+    }
+
+    static void append_value(std::string& json, const Field& field)
+    {
+        switch (field.type)
+        {
+            case Field::Type::boolean:
+                json.append(field.value.boolean ? "true" : "false");
+                break;
+            case Field::Type::integer:
+                Format::append(json, field.value.integer);
+                break;
+            case Field::Type::unsigned_integer:
+                Format::append(json, field.value.unsigned_integer);
+                break;
+            case Field::Type::floating_point:
+                append_double(json, field.value.floating_point);
+                break;
+            case Field::Type::literal:
+                append_string(json, field.value.literal, std::strlen(field.value.literal));
+                break;
+            case Field::Type::string:
+                append_string(json, field.string.data(), field.string.size());
+                break;
+        }
+    }
+
+    /// Shortest representation that reads back as the same double, JSON has no NaN and Infinity
+    static void append_double(std::string& json, double value)
+    {
+        if (!std::isfinite(value))
+        {
+            json.append("null");
+            return;
+        }
+        char buffer[32];
+#if defined(__cpp_lib_to_chars) && (__cpp_lib_to_chars >= 201611L)
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        json.append(buffer, result.ptr);
+#else
+        int size = snprintf(buffer, sizeof(buffer), "%.17g", value);
+        json.append(buffer, static_cast<size_t>(size));
+#endif
+    }
+
+    /// Append "text" with '"', '\\' and control characters escaped.
+    /// Runs of characters that need no escaping are found 16 bytes at a time, if SSE2 is available.
+    static void append_escaped(std::string& json, const char* text, size_t size)
+    {
+        const char* end = text + size;
+        const char* run = text;
+        while (run != end)
+        {
+            const char* pos = find_escape(run, end);
+            json.append(run, pos);
+            if (pos == end)
+                break;
+            unsigned char c = static_cast<unsigned char>(*pos);
+            switch (c)
+            {
+                case '"':
+                    json.append("\\\"");
+                    break;
+                case '\\':
+                    json.append("\\\\");
+                    break;
+                case '\n':
+                    json.append("\\n");
+                    break;
+                case '\r':
+                    json.append("\\r");
+                    break;
+                case '\t':
+                    json.append("\\t");
+                    break;
+                case '\b':
+                    json.append("\\b");
+                    break;
+                case '\f':
+                    json.append("\\f");
+                    break;
+                default:
+                {
+                    static const char hex[] = "0123456789abcdef";
+                    char escaped[] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+                    json.append(escaped, sizeof(escaped));
+                }
+            }
+            run = pos + 1;
+        }
+    }
+
+    static bool needs_escape(unsigned char c)
+    {
+        return (c < 0x20) || (c == '"') || (c == '\\');
+    }
+
+    /// @return the first character in [begin, end) that must be escaped, or "end"
+    static const char* find_escape(const char* begin, const char* end)
+    {
+#ifdef AIXLOG_INTERNAL__SSE2
+        const __m128i quote = _mm_set1_epi8('"');
+        const __m128i backslash = _mm_set1_epi8('\\');
+        const __m128i control = _mm_set1_epi8(0x1f);
+        while (end - begin >= 16)
+        {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+            // c <= 0x1f  <=>  max(c, 0x1f) == 0x1f, unsigned
+            __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+                                        _mm_cmpeq_epi8(_mm_max_epu8(chunk, control), control));
+            if (_mm_movemask_epi8(hits) != 0)
+                break;
+            begin += 16;
+        }
+#endif
+        while ((begin != end) && !needs_escape(static_cast<unsigned char>(*begin)))
+            ++begin;
+        return begin;
+    }
+
+    std::string time_format_;
+};
+
+#ifdef _WIN32
+/**
+ * @brief
+ * Windows: Logging to OutputDebugString
+ *
+ * Not tested due to unavailability of Windows
+ */
+struct SinkOutputDebugString : public Sink
+{
+    SinkOutputDebugString(const Filter& filter) : Sink(filter)
+    {
+    }
+
+    void log(const Metadata& metadata, const std::string& message) override
+    {
+#ifdef UNICODE
+        std::wstring wide = std::wstring(message.begin(), message.end());
+        OutputDebugString(wide.c_str());
+#else
+        OutputDebugString(message.c_str());
+#endif
+    }
+};
+#endif
+
+#ifdef HAS_APPLE_UNIFIED_LOG_
+/**
+ * @brief
+ * macOS: Logging to Apples system logger
+ */
+struct SinkUnifiedLogging : public Sink
+{
+    SinkUnifiedLogging(const Filter& filter) : Sink(filter)
+    {
+    }
+
+    os_log_type_t get_os_log_type(Severity severity) const
+    {
+        // https://developer.apple.com/documentation/os/os_log_type_t?language=objc
+        switch (severity)
+        {
+            case Severity::trace:
+            case Severity::debug:
+                return OS_LOG_TYPE_DEBUG;
+            case Severity::info:
+            case Severity::notice:
+                return OS_LOG_TYPE_INFO;
+            case Severity::warning:
+                return OS_LOG_TYPE_DEFAULT;
+            case Severity::error:
+                return OS_LOG_TYPE_ERROR;
+            case Severity::fatal:
+                return OS_LOG_TYPE_FAULT;
+            default:
+                return OS_LOG_TYPE_DEFAULT;
+        }
+    }
+
+    void log(const Metadata& metadata, const std::string& message) override
+    {
+        os_log_with_type(OS_LOG_DEFAULT, get_os_log_type(metadata.severity), "%{public}s", message.c_str());
+    }
+
+    bool thread_safe() const override
+    {
+        return true;
+    }
+};
+#endif
+
+#ifdef HAS_SYSLOG_
+/**
+ * @brief
+ * UNIX: Logging to syslog
+ */
+struct SinkSyslog : public Sink
+{
+    SinkSyslog(const char* ident, const Filter& filter) : Sink(filter)
+    {
+        openlog(ident, LOG_PID, LOG_USER);
+    }
+
+    ~SinkSyslog() override
+    {
+        closelog();
+    }
+
+    int get_syslog_priority(Severity severity) const
+    {
+        // http://unix.superglobalmegacorp.com/Net2/newsrc/sys/syslog.h.html
+        switch (severity)
+        {
+            case Severity::trace:
+            case Severity::debug:
+                return LOG_DEBUG;
+            case Severity::info:
+                return LOG_INFO;
+            case Severity::notice:
+                return LOG_NOTICE;
+            case Severity::warning:
+                return LOG_WARNING;
+            case Severity::error:
+                return LOG_ERR;
+            case Severity::fatal:
+                return LOG_CRIT;
+            default:
+                return LOG_INFO;
+        }
+    }
+
+    void log(const Metadata& metadata, const std::string& message) override
+    {
+        syslog(get_syslog_priority(metadata.severity), "%s", message.c_str());
+    }
+
+    void log_record(const RecordView& record) override
+    {
+        if (!own_log())
+        {
+            log(record.metadata(), record.message());
+            return;
+        }
+        int size = static_cast<int>(std::min<size_t>(record.text.size, std::numeric_limits<int>::max()));
+        syslog(get_syslog_priority(record.severity), "%.*s", size, record.text.data);
+    }
+
+    bool thread_safe() const override
+    {
+        return true;
+    }
+
+protected:
+    bool own_log() const override
+    {
+        return typeid(*this) == typeid(SinkSyslog);
+    }
+};
+#endif
+
+#ifdef __ANDROID__
+/**
+ * @brief
+ * Android: Logging to android log
+ *
+ * Use logcat to read the logs
+ */
+struct SinkAndroid : public Sink
+{
+    SinkAndroid(const std::string& ident, const Filter& filter) : Sink(filter), ident_(ident)
+    {
+    }
+
+    android_LogPriority get_android_prio(Severity severity) const
+    {
+        // https://developer.android.com/ndk/reference/log_8h.html
+        switch (severity)
+        {
+            case Severity::trace:
+                return ANDROID_LOG_VERBOSE;
+            case Severity::debug:
+                return ANDROID_LOG_DEBUG;
+            case Severity::info:
+            case Severity::notice:
+                return ANDROID_LOG_INFO;
+            case Severity::warning:
+                return ANDROID_LOG_WARN;
+            case Severity::error:
+                return ANDROID_LOG_ERROR;
+            case Severity::fatal:
+                return ANDROID_LOG_FATAL;
+            default:
+                return ANDROID_LOG_UNKNOWN;
+        }
+    }
+
+    void log(const Metadata& metadata, const std::string& message) override
+    {
+        std::string tag = metadata.tag ? metadata.tag.text : (metadata.function ? metadata.function.name : "");
+        std::string log_tag;
+        if (!ident_.empty() && !tag.empty())
+            log_tag = ident_ + "." + tag;
+        else if (!ident_.empty())
+            log_tag = ident_;
+        else if (!tag.empty())
+            log_tag = tag;
+        else
+            log_tag = "log";
+
+        __android_log_write(get_android_prio(metadata.severity), log_tag.c_str(), message.c_str());
+    }
+
+    bool thread_safe() const override
+    {
+        return true;
+    }
+
+protected:
+    std::string ident_;
+};
+#endif
+
+#ifdef _WIN32
+/**
+ * @brief
+ * Windows: Logging to event logger
+ *
+ * Not tested due to unavailability of Windows
+ */
+struct SinkEventLog : public Sink
+{
+    SinkEventLog(const std::string& ident, const Filter& filter) : Sink(filter)
+    {
+#ifdef UNICODE
+        std::wstring wide = std::wstring(ident.begin(), ident.end()); // stijnvdb: RegisterEventSource expands to RegisterEventSourceW which takes wchar_t
+        event_log = RegisterEventSource(NULL, wide.c_str());
+#else
+        event_log = RegisterEventSource(NULL, ident.c_str());
+#endif
+    }
+
+    WORD get_type(Severity severity) const
+    {
+        // https://msdn.microsoft.com/de-de/library/windows/desktop/aa363679(v=vs.85).aspx
+        switch (severity)
+        {
+            case Severity::trace:
+            case Severity::debug:
+                return EVENTLOG_INFORMATION_TYPE;
+            case Severity::info:
+            case Severity::notice:
+                return EVENTLOG_SUCCESS;
+            case Severity::warning:
+                return EVENTLOG_WARNING_TYPE;
+            case Severity::error:
+            case Severity::fatal:
+                return EVENTLOG_ERROR_TYPE;
+            default:
+                return EVENTLOG_INFORMATION_TYPE;
+        }
+    }
+
+    void log(const Metadata& metadata, const std::string& message) override
+    {
+#ifdef UNICODE
+        std::wstring wide = std::wstring(message.begin(), message.end());
+        // We need this temp variable because we cannot take address of rValue
+        const auto* c_str = wide.c_str();
+        ReportEvent(event_log, get_type(metadata.severity), 0, 0, NULL, 1, 0, &c_str, NULL);
+#else
+        const auto* c_str = message.c_str();
+        ReportEvent(event_log, get_type(metadata.severity), 0, 0, NULL, 1, 0, &c_str, NULL);
+#endif
+    }
+
+protected:
+    HANDLE event_log;
+};
+#endif
+
+/**
+ * @brief
+ * Log to the system's native sys logger
+ *
+ * - Android: Android log
+ * - macOS:   unified log
+ * - Windows: event log
+ * - Unix:    syslog
+ */
+struct SinkNative : public Sink
+{
+    SinkNative(const std::string& ident, const Filter& filter) : Sink(filter), log_sink_(nullptr), ident_(ident)
+    {
+#ifdef __ANDROID__
+        log_sink_ = std::make_shared<SinkAndroid>(ident_, filter);
+#elif HAS_APPLE_UNIFIED_LOG_
+        log_sink_ = std::make_shared<SinkUnifiedLogging>(filter);
+#elif _WIN32
+        log_sink_ = std::make_shared<SinkEventLog>(ident, filter);
+#elif HAS_SYSLOG_
+        log_sink_ = std::make_shared<SinkSyslog>(ident_.c_str(), filter);
+#else
+        /// will not throw or something. Use "get_logger()" to check for success
+        log_sink_ = nullptr;
+#endif
+    }
+
+    virtual log_sink_ptr get_logger()
+    {
+        return log_sink_;
+    }
+
+    void log(const Metadata& metadata, const std::string& message) override
+    {
+        if (log_sink_ != nullptr)
+            log_sink_->log(metadata, message);
+    }
+
+protected:
+    log_sink_ptr log_sink_;
+    std::string ident_;
+};
+
+/**
+ * @brief
+ * Forward log messages to a callback function
+ *
+ * Pass the callback function to the c'tor.
+ * This can be any function that matches the signature of "callback_fun"
+ * Might also be a lambda function
+ */
+struct SinkCallback : public Sink
+{
+    using callback_fun = std::function<void(const Metadata& metadata, const std::string& message)>;
+    /// Gets the line without copies, see RecordView
+    using record_callback_fun = std::function<void(const RecordView& record)>;
+    /// Gets one or more lines at once, see Sink::log_batch
+    using batch_callback_fun = std::function<void(const RecordView* records, size_t count)>;
+
+    SinkCallback(const Filter& filter, callback_fun callback) : Sink(filter), callback_(callback)
+    {
+    }
+
+    SinkCallback(const Filter& filter, record_callback_fun callback) : Sink(filter), record_callback_(callback)
+    {
+    }
+
+    SinkCallback(const Filter& filter, batch_callback_fun callback) : Sink(filter), batch_callback_(callback)
+    {
+    }
+
+    void log(const Metadata& metadata, const std::string& message) override
+    {
+        if (callback_)
+            callback_(metadata, message);
+        else
+            log_record(RecordView(metadata, message));
+    }
+
+    void log_record(const RecordView& record) override
+    {
+        if (record_callback_)
+            record_callback_(record);
+        else if (batch_callback_)
+            batch_callback_(&record, 1);
+        else if (callback_)
+            log(record.metadata(), record.message());
+    }
+
+    void log_batch(const RecordView* records, size_t count) override
+    {
+        if (batch_callback_)
+            batch_callback_(records, count);
+        else
+            Sink::log_batch(records, count);
+    }
+
+private:
+    callback_fun callback_;
+    record_callback_fun record_callback_;
+    batch_callback_fun batch_callback_;
+};
+
+/**
+ * @brief
+ * Asynchronous logging to another sink
+ *
+ * Log lines are copied into a preallocated ring buffer of "capacity" entries and a
+ * background thread forwards them to the wrapped sink, so that a slow sink doesn't
+ * block the logging threads. The wrapped sink's filter is taken over in the c'tor.
+ * If the buffer is full, "overflow" decides what happens with a new log line:
+ * - block: wait until there is space again
+ * - drop_newest: discard the new line
+ * - drop_oldest: overwrite the oldest queued line
+ * - drop_below_severity: discard the new line if its severity is below "keep_severity", else block
+ * Queued lines are never lost on "flush" and on destruction.
+ */
+struct SinkAsync : public Sink
+{
+    enum class Overflow
+    {
+        block,
+        drop_newest,
+        drop_oldest,
+        drop_below_severity
+    };
+
+    SinkAsync(const log_sink_ptr& sink, size_t capacity = 8192, Overflow overflow = Overflow::block, Severity keep_severity = Severity::warning)
+        : Sink(sink->filter), sink_(sink), overflow_(overflow), keep_severity_(keep_severity), ring_(std::max<size_t>(capacity, 1)), head_(0),
+          size_(0), dropped_(0), flush_requested_(0), flush_done_(0), stop_(false)
+    {
+        worker_ = std::thread(&SinkAsync::worker, this);
+    }
+
+    ~SinkAsync() override
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        not_empty_.notify_one();
+        worker_.join();
+    }
+
+    void log(const Metadata& metadata, const std::string& message) override
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        push(lock, metadata, message);
+        lock.unlock();
+        not_empty_.notify_one();
+    }
+
+    /// Queues the lines with one lock
+    void log_batch(const RecordView* records, size_t count) override
+    {
+        if (!own_log())
+        {
+            Sink::log_batch(records, count);
+            return;
+        }
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (size_t n = 0; n < count; ++n)
+            push(lock, records[n].metadata(), records[n].message());
+        lock.unlock();
+        not_empty_.notify_one();
+    }
+
+    /// Block until all lines that are queued so far are written by the wrapped sink, and flush it
+    void flush() override
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        size_t ticket = ++flush_requested_;
+        not_empty_.notify_one();
+        flushed_.wait(lock, [this, ticket] { return flush_done_ >= ticket; });
+    }
+
+    /// @return number of log lines that were discarded due to a full buffer
+    size_t dropped() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return dropped_;
+    }
+
+    bool thread_safe() const override
+    {
+        return true;
+    }
+
+    /// The time spent in "log" is the time to queue a line
+    SinkMetrics metrics() const override
+    {
+        SinkMetrics result = Sink::metrics();
+        result.dropped = dropped();
+        return result;
+    }
+
+protected:
+    bool own_log() const override
+    {
+        return typeid(*this) == typeid(SinkAsync);
+    }
+
+private:
+    struct Entry
+    {
+        Metadata metadata;
+        std::string message;
+    };
+
+    /// Queue a line, called with "mutex_" locked
+    void push(std::unique_lock<std::mutex>& lock, const Metadata& metadata, const std::string& message)
+    {
+        if (size_ == ring_.size())
+        {
+            if ((overflow_ == Overflow::drop_newest) || ((overflow_ == Overflow::drop_below_severity) && (metadata.severity < keep_severity_)))
+            {
+                ++dropped_;
+                return;
+            }
+            else if (overflow_ == Overflow::drop_oldest)
+            {
+                head_ = (head_ + 1) % ring_.size();
+                --size_;
+                ++dropped_;
+            }
+            else
+            {
+                not_empty_.notify_one();
+                not_full_.wait(lock, [this] { return size_ < ring_.size(); });
+            }
+        }
+
+        // assignment reuses the capacity of the entry's strings
+        Entry& entry = ring_[(head_ + size_) % ring_.size()];
+        entry.metadata = metadata;
+        entry.metadata.own_fields();
+        entry.message = message;
+        ++size_;
+    }
+
+    void worker()
+    {
+        std::vector<Entry> batch(ring_.size());
+        std::vector<RecordView> records;
+        records.reserve(ring_.size());
+        for (;;)
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            not_empty_.wait(lock, [this] { return (size_ > 0) || stop_ || (flush_requested_ != flush_done_); });
+            // swap the queued entries out, so that the wrapped sink is called without holding the lock
+            size_t count = size_;
+            for (size_t n = 0; n < count; ++n)
+                std::swap(batch[n], ring_[(head_ + n) % ring_.size()]);
+            head_ = (head_ + count) % ring_.size();
+            size_ = 0;
+            size_t flush_ticket = flush_requested_;
+            bool stop = stop_;
+            lock.unlock();
+            not_full_.notify_all();
+
+            // the wrapped sink gets everything that was queued meanwhile in one call
+            records.clear();
+            for (size_t n = 0; n < count; ++n)
+                records.emplace_back(batch[n].metadata, batch[n].message);
+            if (count > 0)
+                sink_->log_batch(records.data(), records.size());
+
+            if (stop || (flush_ticket != flush_done_))
+            {
+                sink_->flush();
+                lock.lock();
+                flush_done_ = flush_ticket;
+                if (stop && (size_ == 0))
+                    break;
+                lock.unlock();
+                flushed_.notify_all();
+            }
+        }
+        flushed_.notify_all();
+    }
+
+    log_sink_ptr sink_;
+    Overflow overflow_;
+    Severity keep_severity_;
+    std::vector<Entry> ring_;
+    size_t head_;
+    size_t size_;
+    size_t dropped_;
+    size_t flush_requested_;
+    size_t flush_done_;
+    bool stop_;
+    mutable std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+    std::condition_variable flushed_;
+    std::thread worker_;
+};
+
+/**
+ * @brief
+ * Collapses consecutive duplicate lines before they reach another sink, see Dedup
+ *
+ * The wrapped sink's filter is taken over in the c'tor. Suppressed repetitions are counted as "dropped".
+ */
+struct SinkDedup : public Sink
+{
+    SinkDedup(const log_sink_ptr& sink, std::chrono::milliseconds window = std::chrono::seconds(30))
+        : Sink(sink->filter), sink_(sink), dedup_(window), dropped_(0)
+    {
+    }
+
+    ~SinkDedup() override
+    {
+        flush();
+    }
+
+    void log(const Metadata& metadata, const std::string& message) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (dedup_.pass(metadata, message, [this](const Metadata& summary, const std::string& text) { log_summary(summary, text); }))
+            sink_->log(metadata, message);
+        else
+            ++dropped_;
+    }
+
+    void log_binary(const BinaryRecord& record) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        dedup_.flush([this](const Metadata& summary, const std::string& text) { log_summary(summary, text); });
+        dedup_.reset();
+        sink_->log_binary(record);
+    }
+
+    /// Emits the pending summary, if any
+    void flush() override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        dedup_.flush([this](const Metadata& summary, const std::string& text) { log_summary(summary, text); });
+        sink_->flush();
+    }
+
+    bool thread_safe() const override
+    {
+        return true;
+    }
+
+    SinkMetrics metrics() const override
+    {
+        SinkMetrics result = Sink::metrics();
+        std::lock_guard<std::mutex> lock(mutex_);
+        result.dropped = dropped_;
+        return result;
+    }
+
+private:
+    void log_summary(const Metadata& summary, const std::string& text)
+    {
+        Log::own_line([this, &summary, &text] { sink_->log(summary, text); });
+    }
+
+    log_sink_ptr sink_;
+    Dedup dedup_;
+    std::uint64_t dropped_;
+    mutable std::mutex mutex_;
+};
+
+#ifndef _WIN32
+/**
+ * @brief
+ * Keeps the last log lines in memory, to be dumped when the process crashes
+ *
+ * Every line goes into a preallocated ring of "lines" slots of "line_size" bytes (longer lines are truncated),
+ * without locks, allocations or system calls. "dump" writes the ring to a file descriptor with async-signal-safe
+ * calls only (write), so that it can be called from a signal handler, see "dump_on_signals". The ring is also dumped
+ * after a line with Severity::fatal. Times are dumped in UTC, since localtime isn't async-signal-safe.
+ * Each slot is guarded by a sequence number, a line is only torn if the ring wraps around while it's written.
+ *
+ * e.g. keep the last 4096 lines of all severities, while other sinks log warnings and above:
+ * auto recorder = std::make_shared<AixLog::SinkFlightRecorder>(AixLog::Severity::trace, 4096);
+ * AixLog::SinkFlightRecorder::dump_on_signals();
+ */
+struct SinkFlightRecorder : public Sink
+{
+    /// @param fd where "dump" writes to, e.g. an already opened file, the default is stderr
+    SinkFlightRecorder(const Filter& filter, size_t lines = 4096, size_t line_size = 256, int fd = STDERR_FILENO, bool dump_on_fatal = true)
+        : Sink(filter), lines_(std::max<size_t>(lines, 1)), line_size_(std::max<size_t>(line_size, 32)), fd_(fd), dump_on_fatal_(dump_on_fatal),
+          slots_(new Slot[lines_]), text_(new char[lines_ * line_size_]), next_(0)
+    {
+        for (size_t n = 0; n < lines_; ++n)
+            slots_[n].sequence.store(0, std::memory_order_relaxed);
+        for (auto& recorder : recorders())
+        {
+            SinkFlightRecorder* expected = nullptr;
+            if (recorder.compare_exchange_strong(expected, this))
+                break;
+        }
+    }
+
+    ~SinkFlightRecorder() override
+    {
+        for (auto& recorder : recorders())
+        {
+            SinkFlightRecorder* expected = this;
+            recorder.compare_exchange_strong(expected, nullptr);
+        }
+    }
+
+    void log(const Metadata& metadata, const std::string& message) override
+    {
+        record_line(RecordView(metadata, message));
+    }
+
+    void log_record(const RecordView& record) override
     {
-        os_log_with_type(OS_LOG_DEFAULT, get_os_log_type(metadata.severity), "%{public}s", message.c_str());
+        if (own_log())
+            record_line(record);
+        else
+            log(record.metadata(), record.message());
     }
-};
-#endif
 
-#ifdef HAS_SYSLOG_
-/**
- * @brief
- * UNIX: Logging to syslog
- */
-struct SinkSyslog : public Sink
-{
-    SinkSyslog(const char* ident, const Filter& filter) : Sink(filter)
+    /// Lock-free
+    bool thread_safe() const override
     {
-        openlog(ident, LOG_PID, LOG_USER);
+        return true;
     }
 
-    ~SinkSyslog() override
+    void dump() const
     {
-        closelog();
+        dump(fd_);
     }
 
-    int get_syslog_priority(Severity severity) const
+    /// Write the recorded lines, oldest first. Async-signal-safe.
+    void dump(int fd) const
     {
-        // http://unix.superglobalmegacorp.com/Net2/newsrc/sys/syslog.h.html
-        switch (severity)
+        std::uint64_t end = next_.load(std::memory_order_acquire);
+        std::uint64_t begin = (end > lines_) ? end - lines_ : 0;
+        write_all(fd, "--- aixlog flight recorder ---\n");
+        char line[64];
+        for (std::uint64_t index = begin; index < end; ++index)
         {
-            case Severity::trace:
-            case Severity::debug:
-                return LOG_DEBUG;
-            case Severity::info:
-                return LOG_INFO;
-            case Severity::notice:
-                return LOG_NOTICE;
-            case Severity::warning:
-                return LOG_WARNING;
-            case Severity::error:
-                return LOG_ERR;
-            case Severity::fatal:
-                return LOG_CRIT;
-            default:
-                return LOG_INFO;
+            const Slot& slot = slots_[index % lines_];
+            if (slot.sequence.load(std::memory_order_acquire) != 2 * index + 2)
+                continue;
+            std::int64_t ns = slot.ns;
+            size_t size = std::min<size_t>(slot.size, line_size_);
+            const char* text = &text_[(index % lines_) * line_size_];
+            size_t time_size = format_time(line, ns);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            // overwritten in the meantime
+            if (slot.sequence.load(std::memory_order_relaxed) != 2 * index + 2)
+                continue;
+            write_all(fd, line, time_size);
+            write_all(fd, text, size);
+            write_all(fd, "\n");
         }
+        write_all(fd, "--- end of aixlog flight recorder ---\n");
     }
 
-    void log(const Metadata& metadata, const std::string& message) override
+    /// Dump all flight recorders from a handler for "signals", e.g. on a crash. The default action of the signal
+    /// follows, i.e. the process still terminates. Call once, recorders that are created later are included.
+    static void dump_on_signals(const std::vector<int>& signals = {SIGSEGV, SIGABRT, SIGBUS, SIGFPE, SIGILL})
     {
-        syslog(get_syslog_priority(metadata.severity), "%s", message.c_str());
+        struct sigaction action;
+        std::memset(&action, 0, sizeof(action));
+        action.sa_handler = on_signal;
+        sigemptyset(&action.sa_mask);
+        // back to the default action when the handler returns, which re-raises the signal
+        action.sa_flags = static_cast<int>(SA_RESETHAND);
+        for (int signal : signals)
+            sigaction(signal, &action, nullptr);
     }
-};
-#endif
 
-#ifdef __ANDROID__
-/**
- * @brief
- * Android: Logging to android log
- *
- * Use logcat to read the logs
- */
-struct SinkAndroid : public Sink
-{
-    SinkAndroid(const std::string& ident, const Filter& filter) : Sink(filter), ident_(ident)
+protected:
+    bool own_log() const override
     {
+        return typeid(*this) == typeid(SinkFlightRecorder);
     }
 
-    android_LogPriority get_android_prio(Severity severity) const
+private:
+    /// Put a line into the ring, without going through the virtual "log" or "log_record"
+    void record_line(const RecordView& record)
     {
-        // https://developer.android.com/ndk/reference/log_8h.html
-        switch (severity)
-        {
-            case Severity::trace:
-                return ANDROID_LOG_VERBOSE;
-            case Severity::debug:
-                return ANDROID_LOG_DEBUG;
-            case Severity::info:
-            case Severity::notice:
-                return ANDROID_LOG_INFO;
-            case Severity::warning:
-                return ANDROID_LOG_WARN;
-            case Severity::error:
-                return ANDROID_LOG_ERROR;
-            case Severity::fatal:
-                return ANDROID_LOG_FATAL;
-            default:
-                return ANDROID_LOG_UNKNOWN;
-        }
+        std::uint64_t index = next_.fetch_add(1, std::memory_order_relaxed);
+        Slot& slot = slots_[index % lines_];
+        slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        char* text = &text_[(index % lines_) * line_size_];
+        size_t size = 0;
+        append(text, size, "[");
+        append(text, size, to_string(record.severity));
+        append(text, size, "] (");
+        if (record.tag)
+            append(text, size, record.tag.data, record.tag.size);
+        else if (record.function)
+            append(text, size, record.function.data, record.function.size);
+        else
+            append(text, size, "log");
+        append(text, size, ") ");
+        append(text, size, record.text.data, record.text.size);
+        slot.size = static_cast<std::uint32_t>(size);
+        slot.ns = record.timestamp ? std::chrono::duration_cast<std::chrono::nanoseconds>(record.timestamp.time_point.time_since_epoch()).count() : -1;
+
+        std::uint64_t writing = 2 * index + 1;
+        slot.sequence.compare_exchange_strong(writing, 2 * index + 2, std::memory_order_release, std::memory_order_relaxed);
+
+        if (dump_on_fatal_ && (record.severity == Severity::fatal))
+            dump();
     }
 
-    void log(const Metadata& metadata, const std::string& message) override
+    struct Slot
     {
-        std::string tag = metadata.tag ? metadata.tag.text : (metadata.function ? metadata.function.name : "");
-        std::string log_tag;
-        if (!ident_.empty() && !tag.empty())
-            log_tag = ident_ + "." + tag;
-        else if (!ident_.empty())
-            log_tag = ident_;
-        else if (!tag.empty())
-            log_tag = tag;
-        else
-            log_tag = "log";
+        /// 2 * index + 1 while line "index" is written, 2 * index + 2 when it's complete
+        std::atomic<std::uint64_t> sequence;
+        std::int64_t ns;
+        std::uint32_t size;
+    };
 
-        __android_log_write(get_android_prio(metadata.severity), log_tag.c_str(), message.c_str());
+    void append(char* text, size_t& size, const char* value) const
+    {
+        append(text, size, value, std::strlen(value));
     }
 
-protected:
-    std::string ident_;
-};
-#endif
+    void append(char* text, size_t& size, const std::string& value) const
+    {
+        append(text, size, value.data(), value.size());
+    }
 
-#ifdef _WIN32
-/**
- * @brief
- * Windows: Logging to event logger
- *
- * Not tested due to unavailability of Windows
- */
-struct SinkEventLog : public Sink
-{
-    SinkEventLog(const std::string& ident, const Filter& filter) : Sink(filter)
+    void append(char* text, size_t& size, const char* value, size_t length) const
     {
-#ifdef UNICODE
-        std::wstring wide = std::wstring(ident.begin(), ident.end()); // stijnvdb: RegisterEventSource expands to RegisterEventSourceW which takes wchar_t
-        event_log = RegisterEventSource(NULL, wide.c_str());
-#else
-        event_log = RegisterEventSource(NULL, ident.c_str());
-#endif
+        length = std::min(length, line_size_ - size);
+        std::memcpy(text + size, value, length);
+        size += length;
     }
 
-    WORD get_type(Severity severity) const
+    static void write_all(int fd, const char* text)
     {
-        // https://msdn.microsoft.com/de-de/library/windows/desktop/aa363679(v=vs.85).aspx
-        switch (severity)
+        write_all(fd, text, std::strlen(text));
+    }
+
+    static void write_all(int fd, const char* text, size_t size)
+    {
+        while (size > 0)
         {
-            case Severity::trace:
-            case Severity::debug:
-                return EVENTLOG_INFORMATION_TYPE;
-            case Severity::info:
-            case Severity::notice:
-                return EVENTLOG_SUCCESS;
-            case Severity::warning:
-                return EVENTLOG_WARNING_TYPE;
-            case Severity::error:
-            case Severity::fatal:
-                return EVENTLOG_ERROR_TYPE;
-            default:
-                return EVENTLOG_INFORMATION_TYPE;
+            ssize_t written = ::write(fd, text, size);
+            if (written <= 0)
+                return;
+            text += written;
+            size -= static_cast<size_t>(written);
         }
     }
 
-    void log(const Metadata& metadata, const std::string& message) override
+    /// "YYYY-MM-DD HH:MM:SS.uuuuuu " in UTC, or "-" if there is no time stamp. No library calls.
+    static size_t format_time(char* line, std::int64_t ns)
     {
-#ifdef UNICODE
-        std::wstring wide = std::wstring(message.begin(), message.end());
-        // We need this temp variable because we cannot take address of rValue
-        const auto* c_str = wide.c_str();
-        ReportEvent(event_log, get_type(metadata.severity), 0, 0, NULL, 1, 0, &c_str, NULL);
-#else
-        const auto* c_str = message.c_str();
-        ReportEvent(event_log, get_type(metadata.severity), 0, 0, NULL, 1, 0, &c_str, NULL);
-#endif
+        if (ns < 0)
+        {
+            std::memcpy(line, "- ", 2);
+            return 2;
+        }
+        std::int64_t seconds = ns / 1000000000;
+        std::int64_t us = (ns % 1000000000) / 1000;
+        std::int64_t days = seconds / 86400;
+        std::int64_t second_of_day = seconds % 86400;
+        // days since 1970-01-01 to the civil date, http://howardhinnant.github.io/date_algorithms.html
+        std::int64_t z = days + 719468;
+        std::int64_t era = z / 146097;
+        std::int64_t doe = z - era * 146097;
+        std::int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        std::int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        std::int64_t mp = (5 * doy + 2) / 153;
+        std::int64_t day = doy - (153 * mp + 2) / 5 + 1;
+        std::int64_t month = (mp < 10) ? mp + 3 : mp - 9;
+        std::int64_t year = yoe + era * 400 + ((month <= 2) ? 1 : 0);
+
+        size_t size = 0;
+        auto put = [line, &size](std::int64_t value, int digits, char separator) {
+            for (int n = digits - 1; n >= 0; --n)
+            {
+                line[size + static_cast<size_t>(n)] = static_cast<char>('0' + value % 10);
+                value /= 10;
+            }
+            size += static_cast<size_t>(digits);
+            line[size++] = separator;
+        };
+        put(year, 4, '-');
+        put(month, 2, '-');
+        put(day, 2, ' ');
+        put(second_of_day / 3600, 2, ':');
+        put(second_of_day / 60 % 60, 2, ':');
+        put(second_of_day % 60, 2, '.');
+        put(us, 6, ' ');
+        return size;
     }
 
-protected:
-    HANDLE event_log;
+    static void on_signal(int /*signal*/)
+    {
+        for (const auto& recorder : recorders())
+        {
+            SinkFlightRecorder* sink = recorder.load(std::memory_order_acquire);
+            if (sink != nullptr)
+                sink->dump();
+        }
+    }
+
+    /// Recorders that are dumped on signals
+    static std::atomic<SinkFlightRecorder*> (&recorders())[8]
+    {
+        static std::atomic<SinkFlightRecorder*> recorders[8] = {};
+        return recorders;
+    }
+
+    size_t lines_;
+    size_t line_size_;
+    int fd_;
+    bool dump_on_fatal_;
+    std::unique_ptr<Slot[]> slots_;
+    std::unique_ptr<char[]> text_;
+    std::atomic<std::uint64_t> next_;
 };
 #endif
 
 /**
  * @brief
- * Log to the system's native sys logger
+ * Reports Log::metrics periodically from a background thread, for as long as it exists
  *
- * - Android: Android log
- * - macOS:   unified log
- * - Windows: event log
- * - Unix:    syslog
+ * Without a callback, the metrics are logged as info with tag "aixlog", one line per sink.
  */
-struct SinkNative : public Sink
+struct MetricsReport
 {
-    SinkNative(const std::string& ident, const Filter& filter) : Sink(filter), log_sink_(nullptr), ident_(ident)
+    using callback_fun = std::function<void(const LogMetrics& metrics)>;
+
+    MetricsReport(std::chrono::milliseconds interval, callback_fun callback = nullptr) : interval_(interval), callback_(callback), stop_(false)
     {
-#ifdef __ANDROID__
-        log_sink_ = std::make_shared<SinkAndroid>(ident_, filter);
-#elif HAS_APPLE_UNIFIED_LOG_
-        log_sink_ = std::make_shared<SinkUnifiedLogging>(filter);
-#elif _WIN32
-        log_sink_ = std::make_shared<SinkEventLog>(ident, filter);
-#elif HAS_SYSLOG_
-        log_sink_ = std::make_shared<SinkSyslog>(ident_.c_str(), filter);
-#else
-        /// will not throw or something. Use "get_logger()" to check for success
-        log_sink_ = nullptr;
-#endif
+        if (!callback_)
+            callback_ = log_metrics;
+        worker_ = std::thread(&MetricsReport::worker, this);
     }
 
-    virtual log_sink_ptr get_logger()
+    ~MetricsReport()
     {
-        return log_sink_;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        stop_cv_.notify_one();
+        worker_.join();
     }
 
-    void log(const Metadata& metadata, const std::string& message) override
+    static void log_metrics(const LogMetrics& metrics)
     {
-        if (log_sink_ != nullptr)
-            log_sink_->log(metadata, message);
+        LOG(AixLog::Severity::info, "aixlog") << "lines: " << metrics.lines << ", lock waits: " << metrics.lock_waits
+                                              << ", lock wait: " << metrics.lock_wait_ns / 1000 << " us\n";
+        for (size_t n = 0; n < metrics.sinks.size(); ++n)
+        {
+            const SinkMetrics& sink = metrics.sinks[n].second;
+            LOG(AixLog::Severity::info, "aixlog") << "sink " << n << ": offered: " << sink.offered << ", filtered: " << sink.filtered
+                                                  << ", written: " << sink.written << ", bytes: " << sink.bytes << ", dropped: " << sink.dropped
+                                                  << ", log time: " << sink.log_time_ns / 1000 << " us, p50: " << sink.log_time_percentile(0.5)
+                                                  << " ns, p99: " << sink.log_time_percentile(0.99) << " ns\n";
+        }
     }
 
-protected:
-    log_sink_ptr log_sink_;
-    std::string ident_;
+private:
+    void worker()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stop_cv_.wait_for(lock, interval_, [this] { return stop_; }))
+        {
+            lock.unlock();
+            callback_(Log::instance().metrics());
+            lock.lock();
+        }
+    }
+
+    std::chrono::milliseconds interval_;
+    callback_fun callback_;
+    bool stop_;
+    std::mutex mutex_;
+    std::condition_variable stop_cv_;
+    std::thread worker_;
 };
 
+#ifdef __linux__
 /**
  * @brief
- * Forward log messages to a callback function
+ * Applies a filter spec like "*:WARNING,net:DEBUG" from a file to sinks, and again whenever the file is written
  *
- * Pass the callback function to the c'tor.
- * This can be any function that matches the signature of "callback_fun"
- * Might also be a lambda function
+ * The file's directory is watched with inotify from a background thread, for as long as the reloader exists,
+ * so that also files that are replaced by renaming (as editors do) are picked up. The sinks keep their limiters.
+ * Lines starting with '#' are comments.
  */
-struct SinkCallback : public Sink
+struct FilterReloader
 {
-    using callback_fun = std::function<void(const Metadata& metadata, const std::string& message)>;
+    FilterReloader(const std::string& path, const std::vector<log_sink_ptr>& sinks) : path_(path), sinks_(sinks), inotify_(-1), stop_(-1)
+    {
+        reload();
+        auto slash = path_.rfind('/');
+        std::string directory = (slash == std::string::npos) ? "." : path_.substr(0, std::max<size_t>(slash, 1));
+        name_ = path_.substr((slash == std::string::npos) ? 0 : slash + 1);
+        inotify_ = inotify_init1(IN_CLOEXEC);
+        stop_ = eventfd(0, EFD_CLOEXEC);
+        if ((inotify_ >= 0) && (stop_ >= 0) && (inotify_add_watch(inotify_, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) >= 0))
+            worker_ = std::thread(&FilterReloader::worker, this);
+    }
 
-    SinkCallback(const Filter& filter, callback_fun callback) : Sink(filter), callback_(callback)
+    ~FilterReloader()
+    {
+        if (worker_.joinable())
+        {
+            std::uint64_t one = 1;
+            (void)!::write(stop_, &one, sizeof(one));
+            worker_.join();
+        }
+        if (inotify_ >= 0)
+            close(inotify_);
+        if (stop_ >= 0)
+            close(stop_);
+    }
+
+    /// @return false if the file can't be watched, it's still applied once
+    bool watching() const
     {
+        return worker_.joinable();
     }
 
-    void log(const Metadata& metadata, const std::string& message) override
+    /// Apply the file now. A missing or empty file leaves the filters as they are.
+    void reload()
     {
-        if (callback_)
-            callback_(metadata, message);
+        std::ifstream ifs(path_.c_str());
+        std::string spec;
+        std::string line;
+        while (std::getline(ifs, line))
+        {
+            if (line.empty() || (line[0] != '#'))
+                spec.append(line).push_back('\n');
+        }
+        if (spec.find_first_not_of(" \t\r\n") == std::string::npos)
+            return;
+
+        Filter filter;
+        filter.add_filter(spec);
+        for (const auto& sink : sinks_)
+            Log::instance().set_filter(sink, filter);
     }
 
 private:
-    callback_fun callback_;
+    void worker()
+    {
+        alignas(inotify_event) char buffer[4096];
+        pollfd fds[2] = {{inotify_, POLLIN, 0}, {stop_, POLLIN, 0}};
+        for (;;)
+        {
+            fds[0].revents = fds[1].revents = 0;
+            if (poll(fds, 2, -1) < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return;
+            }
+            if (fds[1].revents != 0)
+                return;
+            if ((fds[0].revents & POLLIN) == 0)
+                continue;
+            ssize_t size = ::read(inotify_, buffer, sizeof(buffer));
+            bool changed = false;
+            for (ssize_t pos = 0; pos < size;)
+            {
+                const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + pos);
+                changed |= (event->len > 0) && (name_ == event->name);
+                pos += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+            }
+            if (changed)
+                reload();
+        }
+    }
+
+    std::string path_;
+    std::string name_;
+    std::vector<log_sink_ptr> sinks_;
+    int inotify_;
+    /// eventfd to wake up and stop the worker
+    int stop_;
+    std::thread worker_;
 };
+#endif
 
 /**
  * @brief
@@ -1141,16 +5971,19 @@ static std::ostream& operator<<(std::ostream& os, const Severity& log_severity)
     Log* log = dynamic_cast<Log*>(os.rdbuf());
     if (log != nullptr)
     {
-        std::lock_guard<std::recursive_mutex> lock(log->mutex_);
-        if (log->metadata_.severity != log_severity)
+        Record& record = Log::record();
+        if (record.metadata.severity != log_severity)
         {
             log->sync();
-            log->metadata_.severity = log_severity;
-            log->metadata_.timestamp = nullptr;
-            log->metadata_.tag = nullptr;
-            log->metadata_.function = nullptr;
-            log->do_log_ = true;
+            record.metadata.severity = log_severity;
+            record.metadata.timestamp = nullptr;
+            record.metadata.tag = nullptr;
+            record.metadata.function = nullptr;
+            record.location_pending = false;
+            record.metadata.fields.clear();
         }
+        // a COND or limiter of the previous statement must not affect this one
+        record.do_log = true;
     }
     else
     {
@@ -1164,8 +5997,7 @@ static std::ostream& operator<<(std::ostream& os, const Timestamp& timestamp)
     Log* log = dynamic_cast<Log*>(os.rdbuf());
     if (log != nullptr)
     {
-        std::lock_guard<std::recursive_mutex> lock(log->mutex_);
-        log->metadata_.timestamp = timestamp;
+        Log::record().metadata.timestamp = timestamp;
     }
     else if (timestamp)
     {
@@ -1179,8 +6011,7 @@ static std::ostream& operator<<(std::ostream& os, const Tag& tag)
     Log* log = dynamic_cast<Log*>(os.rdbuf());
     if (log != nullptr)
     {
-        std::lock_guard<std::recursive_mutex> lock(log->mutex_);
-        log->metadata_.tag = tag;
+        Log::record().metadata.tag = tag;
     }
     else if (tag)
     {
@@ -1194,8 +6025,9 @@ static std::ostream& operator<<(std::ostream& os, const Function& function)
     Log* log = dynamic_cast<Log*>(os.rdbuf());
     if (log != nullptr)
     {
-        std::lock_guard<std::recursive_mutex> lock(log->mutex_);
-        log->metadata_.function = function;
+        Record& record = Log::record();
+        record.metadata.function = function;
+        record.location_pending = false;
     }
     else if (function)
     {
@@ -1204,13 +6036,67 @@ static std::ostream& operator<<(std::ostream& os, const Function& function)
     return os;
 }
 
+static std::ostream& operator<<(std::ostream& os, const SourceLocation& location)
+{
+    Log* log = dynamic_cast<Log*>(os.rdbuf());
+    if (log != nullptr)
+    {
+        Record& record = Log::record();
+        record.location = location;
+        record.location_pending = true;
+    }
+    else if (location.function != nullptr)
+    {
+        os << location.function;
+    }
+    return os;
+}
+
 static std::ostream& operator<<(std::ostream& os, const Conditional& conditional)
 {
     Log* log = dynamic_cast<Log*>(os.rdbuf());
     if (log != nullptr)
     {
-        std::lock_guard<std::recursive_mutex> lock(log->mutex_);
-        log->do_log_ = conditional.is_true();
+        Log::record().do_log = conditional.is_true();
+    }
+    return os;
+}
+
+static std::ostream& operator<<(std::ostream& os, Limiter& limiter)
+{
+    Log* log = dynamic_cast<Log*>(os.rdbuf());
+    if (log != nullptr)
+    {
+        Record& record = Log::record();
+        if (record.do_log)
+            record.do_log = limiter.allow(record.metadata.severity, record.metadata.tag.id);
+        std::uint64_t suppressed = record.do_log ? limiter.take_suppressed() : 0;
+        if (suppressed > 0)
+        {
+            Metadata metadata;
+            std::string message;
+            Log::suppressed_line(metadata, message, Log::view_of(record).metadata(), suppressed);
+            log->dispatch(metadata, message);
+        }
+    }
+    return os;
+}
+
+static std::ostream& operator<<(std::ostream& os, const Field& field)
+{
+    Log* log = dynamic_cast<Log*>(os.rdbuf());
+    if (log != nullptr)
+    {
+        Record& record = Log::record();
+        if (record.do_log)
+            record.metadata.fields.push_back(field);
+    }
+    else
+    {
+        std::string text(field.key);
+        text.push_back('=');
+        field.append_value(text);
+        os << text;
     }
     return os;
 }